@@ -15,6 +15,7 @@
 #include <random>
 #include <string>
 #include <vector>
+#include <array>
 #include <queue>
 #include <math.h>
 #include <iostream>
@@ -28,6 +29,40 @@
 #include <set>
 #include <iomanip>
 #include <sstream>
+#include <climits>
+#include <cstdint>
+#include <limits>
+#include <cstddef>
+#include <new>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <memory>
+#include <condition_variable>
+#include <cstring>
+
+// 二进制数据集以内存映射方式加载
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#define KNN_HAS_MMAP 1
+#elif defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KNN_HAS_MMAP 1
+#else
+#define KNN_HAS_MMAP 0
+#endif
+
+#include "simd.hpp"
 
 /// @brief 
 namespace knn {
@@ -52,6 +87,162 @@ namespace knn {
         std::chrono::microseconds interval;
     };
 
+    /// @brief 进程内共享的work-stealing线程池
+    /// 每个工作线程拥有自己的任务队列，从队尾取自己的任务，空闲时从其他队列队首窃取
+    class ThreadPool {
+        public:
+        /// @brief 以给定线程数初始化，非正数时使用硬件线程数
+        /// @param __thread_cnt 线程数
+        explicit ThreadPool(int __thread_cnt) {
+            if (__thread_cnt <= 0) __thread_cnt = std::max(1u, std::thread::hardware_concurrency());
+            queues.reserve(__thread_cnt);
+            for (int i = 0; i < __thread_cnt; ++i) {
+                queues.push_back(std::make_unique<WorkQueue>());
+            }
+            threads.reserve(__thread_cnt);
+            for (int i = 0; i < __thread_cnt; ++i) {
+                threads.emplace_back(&ThreadPool::workerLoop, this, i);
+            }
+        }
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto& th : threads) th.join();
+        }
+
+        /// @brief 提交任务
+        /// @param __func 无参可调用对象
+        /// @return 对应结果的`std::future`
+        template<class __F>
+        auto submit(__F&& __func) -> std::future<std::invoke_result_t<std::decay_t<__F>>> {
+            typedef std::invoke_result_t<std::decay_t<__F>> ret_type;
+            auto task = std::make_shared<std::packaged_task<ret_type()>>(std::forward<__F>(__func));
+            std::future<ret_type> fut = task->get_future();
+            int target = (current_pool == this) ? current_index
+                         : static_cast<int>(next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size());
+            {
+                std::lock_guard<std::mutex> guard(queues[target]->lock);
+                queues[target]->tasks.emplace_back([task]() { (*task)(); });
+            }
+            {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+                pending += 1;
+            }
+            wake.notify_one();
+            return fut;
+        }
+
+        /// @brief 等待结果，等待期间在当前线程上执行池中的其他任务，避免池内任务互相等待而死锁
+        /// @param __future 由`submit`返回的`std::future`
+        /// @return 任务结果
+        template<class __R>
+        __R wait(std::future<__R>& __future) {
+            while (__future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                if (!runOne(current_pool == this ? current_index : -1)) {
+                    __future.wait_for(std::chrono::microseconds(50));
+                }
+            }
+            return __future.get();
+        }
+
+        inline int size() const { return static_cast<int>(threads.size()); }
+
+        /// @brief 设置全局线程池的线程数，应在全局池空闲时调用
+        /// @param __thread_cnt 线程数，非正数时使用硬件线程数
+        static void configure(int __thread_cnt) {
+            std::lock_guard<std::mutex> guard(globalLock());
+            auto& instance = globalInstance();
+            if (__thread_cnt <= 0) __thread_cnt = std::max(1u, std::thread::hardware_concurrency());
+            if (instance && instance->size() == __thread_cnt) return;
+            instance.reset();
+            instance = std::make_unique<ThreadPool>(__thread_cnt);
+        }
+        /// @brief 获取全局线程池，未配置时以硬件线程数创建
+        static ThreadPool& global() {
+            std::lock_guard<std::mutex> guard(globalLock());
+            auto& instance = globalInstance();
+            if (!instance) instance = std::make_unique<ThreadPool>(0);
+            return *instance;
+        }
+
+        private:
+        struct WorkQueue {
+            std::mutex lock;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        static std::unique_ptr<ThreadPool>& globalInstance() {
+            static std::unique_ptr<ThreadPool> instance;
+            return instance;
+        }
+        static std::mutex& globalLock() {
+            static std::mutex lock;
+            return lock;
+        }
+
+        /// @brief 取出并执行一个任务，先取自己队列的队尾，再从其他队列队首窃取
+        bool runOne(int __self) {
+            std::function<void()> task;
+            const int cnt = static_cast<int>(queues.size());
+            if (__self >= 0) {
+                std::lock_guard<std::mutex> guard(queues[__self]->lock);
+                if (!queues[__self]->tasks.empty()) {
+                    task = std::move(queues[__self]->tasks.back());
+                    queues[__self]->tasks.pop_back();
+                }
+            }
+            if (!task) {
+                int start = (__self >= 0) ? __self + 1 : 0;
+                for (int i = 0; i < cnt && !task; ++i) {
+                    WorkQueue& victim = *queues[(start + i) % cnt];
+                    std::lock_guard<std::mutex> guard(victim.lock);
+                    if (!victim.tasks.empty()) {
+                        task = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                    }
+                }
+            }
+            if (!task) return false;
+            {
+                std::lock_guard<std::mutex> guard(sleep_lock);
+                pending -= 1;
+            }
+            task();
+            return true;
+        }
+
+        void workerLoop(int __index) {
+            current_pool = this;
+            current_index = __index;
+            while (true) {
+                if (runOne(__index)) continue;
+                std::unique_lock<std::mutex> guard(sleep_lock);
+                wake.wait(guard, [this]() { return stopping || pending > 0; });
+                if (stopping && pending == 0) break;
+            }
+            current_pool = nullptr;
+            current_index = -1;
+        }
+
+        std::vector<std::unique_ptr<WorkQueue>> queues;
+        std::vector<std::thread> threads;
+        std::mutex sleep_lock;
+        std::condition_variable wake;
+        long long pending = 0;
+        bool stopping = false;
+        std::atomic<unsigned> next_queue{0};
+        static inline thread_local ThreadPool* current_pool = nullptr;
+        static inline thread_local int current_index = -1;
+    };
+
+    /// @brief 表示标签未编号
+    constexpr std::uint32_t no_label_id = std::numeric_limits<std::uint32_t>::max();
+
     /// @brief 一条数据记录
     /// @tparam __T 向量的数据类型
     /// @tparam __ST 类别的数据类型
@@ -61,13 +252,134 @@ namespace knn {
         __ST state;
     };
 
-    /// @brief KDTree的节点
+    /// @brief 数据集中一行数据的轻量视图，不持有数据
     /// @tparam __T 向量的数据类型
     /// @tparam __ST 类别的数据类型
     template<class __T, class __ST>
-    struct KDNode {
-        const Record<__T, __ST>* rec_ptr;
-        KDNode<__T, __ST> *left_ptr, *right_ptr, *father;
+    struct RecordView {
+        const __T* vec;
+        const __ST* state;
+        long long dimension;
+        long long index;
+        /// @brief 标签在数据集标签表中的编号，数据集不对标签编号时为`no_label_id`
+        std::uint32_t label = no_label_id;
+    };
+
+    /// @brief 标签表：将标签映射为从0开始的连续编号，编号按标签首次出现的顺序分配，标签的地址在加入后保持不变
+    /// @tparam __ST 标签的数据类型，需可哈希
+    template<class __ST>
+    class LabelTable {
+        public:
+        /// @brief 返回标签的编号，标签不存在时加入
+        std::uint32_t intern(const __ST& __label) {
+            auto it = index.find(__label);
+            if (it != index.end()) return it->second;
+            const std::uint32_t id = static_cast<std::uint32_t>(values.size());
+            values.push_back(__label);
+            index.emplace(__label, id);
+            return id;
+        }
+        /// @brief 返回标签的编号，标签不存在时返回`no_label_id`
+        inline std::uint32_t find(const __ST& __label) const {
+            auto it = index.find(__label);
+            return (it != index.end()) ? it->second : no_label_id;
+        }
+        inline const __ST& at(std::uint32_t __id) const { return values[__id]; }
+        inline std::size_t size() const { return values.size(); }
+        void clear() {
+            values.clear();
+            index.clear();
+        }
+
+        private:
+        std::deque<__ST> values;
+        std::unordered_map<__ST, std::uint32_t> index;
+    };
+
+    /// @brief 按固定字节对齐分配内存的分配器
+    /// @tparam __T 元素类型
+    /// @tparam __Align 对齐字节数
+    template<class __T, std::size_t __Align = 64>
+    struct AlignedAllocator {
+        typedef __T value_type;
+        template<class __U> struct rebind { typedef AlignedAllocator<__U, __Align> other; };
+
+        AlignedAllocator() = default;
+        template<class __U>
+        AlignedAllocator(const AlignedAllocator<__U, __Align>&) {}
+
+        __T* allocate(std::size_t __n) {
+            return static_cast<__T*>(::operator new(__n * sizeof(__T), std::align_val_t(__Align)));
+        }
+        void deallocate(__T* __ptr, std::size_t) {
+            ::operator delete(__ptr, std::align_val_t(__Align));
+        }
+        template<class __U>
+        bool operator==(const AlignedAllocator<__U, __Align>&) const { return true; }
+        template<class __U>
+        bool operator!=(const AlignedAllocator<__U, __Align>&) const { return false; }
+    };
+
+    /// @brief 只读映射整个文件，析构时解除映射
+    class MappedFile {
+        public:
+        /// @brief 映射给定文件，失败或平台不支持时返回`nullptr`
+        /// @param __path 文件路径
+        static std::shared_ptr<MappedFile> open(const char* __path) {
+            std::shared_ptr<MappedFile> ret(new MappedFile());
+#if KNN_HAS_MMAP && defined(_WIN32)
+            ret->file = CreateFileA(__path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (ret->file == INVALID_HANDLE_VALUE) return nullptr;
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(ret->file, &file_size) || file_size.QuadPart <= 0) return nullptr;
+            ret->mapping = CreateFileMappingA(ret->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (ret->mapping == nullptr) return nullptr;
+            void* base = MapViewOfFile(ret->mapping, FILE_MAP_READ, 0, 0, 0);
+            if (base == nullptr) return nullptr;
+            ret->base = static_cast<const char*>(base);
+            ret->length = static_cast<std::size_t>(file_size.QuadPart);
+#elif KNN_HAS_MMAP
+            int fd = ::open(__path, O_RDONLY);
+            if (fd < 0) return nullptr;
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+                ::close(fd);
+                return nullptr;
+            }
+            void* base = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (base == MAP_FAILED) return nullptr;
+            ret->base = static_cast<const char*>(base);
+            ret->length = static_cast<std::size_t>(st.st_size);
+#else
+            return nullptr;
+#endif
+            return ret;
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() {
+#if KNN_HAS_MMAP && defined(_WIN32)
+            if (base != nullptr) UnmapViewOfFile(base);
+            if (mapping != nullptr) CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#elif KNN_HAS_MMAP
+            if (base != nullptr) ::munmap(const_cast<char*>(base), length);
+#endif
+        }
+
+        inline const char* data() const { return base; }
+        inline std::size_t size() const { return length; }
+
+        private:
+        MappedFile() = default;
+        const char* base = nullptr;
+        std::size_t length = 0;
+#if KNN_HAS_MMAP && defined(_WIN32)
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
     };
 
     /// @brief 数据集基类
@@ -76,11 +388,13 @@ namespace knn {
     template<class __T, class __ST>
     class DataSet {
         public:
-        /// @brief 返回编号对应的数据记录的指针
+        /// @brief 返回编号对应的数据行视图
         /// @param __index 编号
-        /// @return 指向对应数据的指针
-        virtual Record<__T, __ST>* getRef(long long __index) = 0;
-        virtual const Record<__T, __ST>* getRef(long long __index) const = 0;
+        /// @return 对应数据行的`RecordView`
+        virtual RecordView<__T, __ST> getRef(long long __index) const = 0;
+        /// @brief 返回按行连续存放的特征块，不连续存放时返回`nullptr`
+        /// @return 指向第0行首元素的指针
+        virtual const __T* featureData() const { return nullptr; }
         /// @brief 返回数据维度
         /// @return 表维度的`long long`
         virtual long long getDimension() const = 0;
@@ -89,11 +403,81 @@ namespace knn {
         virtual long long dataSize() const = 0;
         virtual inline void appendRecord(const std::vector<__T>& __vec, const __ST __state) = 0;
         virtual inline void appendRecord(const Record<__T, __ST>& __record) = 0;
+        virtual inline void appendRecord(const RecordView<__T, __ST>& __view) = 0;
         virtual void clear() = 0;
         virtual std::vector<__T> syncNormalization(const std::vector<__T>& __vec) const = 0;
+        /// @brief 标签编号的上界，`getRef`返回的`label`均小于该值；为0时数据集不对标签编号
+        virtual long long labelCount() const { return 0; }
+        /// @brief 返回标签的编号，不存在或数据集不对标签编号时返回`no_label_id`
+        virtual std::uint32_t findLabel(const __ST&) const { return no_label_id; }
+        virtual ~DataSet() = default;
+    };
+
+    /// @brief 数据集的特征储存类型
+    enum class StorageType : long long { Float64 = 0, Float32 = 1, Int8 = 2 };
+    /// @brief 储存类型对应的标记，`float`与`int8_t`之外的类型沿用无标记的二进制格式
+    template<class __T>
+    inline constexpr StorageType storage_type_of = std::is_same_v<__T, float> ? StorageType::Float32
+                                                 : std::is_same_v<__T, std::int8_t> ? StorageType::Int8
+                                                 : StorageType::Float64;
+
+    /// @brief 第2版二进制数据集的文件头，偏移量均相对文件头起点。
+    /// 其后依次为64字节对齐的特征块、标签块与标准化参数块。
+    /// 第3版起标准化参数以`double`保存，第2版为`dtype`宽度
+    struct DataSetBinHeader {
+        char magic[8];
+        std::uint32_t version;
+        /// @brief 写入端以本机字节序写下的`bin_endian`
+        std::uint32_t endian;
+        /// @brief `StorageType`与单个特征的字节数
+        std::uint32_t dtype;
+        std::uint32_t dtype_size;
+        /// @brief 0为算术类型标签原样保存，1为驻留的字符串标签表
+        std::uint32_t label_kind;
+        std::uint32_t label_size;
+        std::int64_t tot_samples;
+        std::int64_t dimension;
+        std::uint64_t feature_offset;
+        std::uint64_t label_offset;
+        std::uint64_t stats_offset;
+        std::uint64_t total_bytes;
+    };
+    inline constexpr char bin_magic[8] = {'K', 'N', 'N', 'D', 'S', 'E', 'T', '\0'};
+    inline constexpr std::uint32_t bin_version = 3;
+    inline constexpr std::uint32_t bin_endian = 0x01020304;
+    inline constexpr std::uint64_t bin_align = 64;
+
+    /// @brief 读取二进制数据集的储存类型，不移动流的读取位置
+    /// @param fin 位于数据集开头的二进制输入流
+    inline StorageType peekStorageType(std::ifstream& fin) {
+        auto pos = fin.tellg();
+        DataSetBinHeader header{};
+        fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+        fin.clear();
+        fin.seekg(pos);
+        if (std::memcmp(header.magic, bin_magic, sizeof(bin_magic)) == 0) {
+            return static_cast<StorageType>(header.dtype);
+        }
+        // 旧格式中非默认的储存类型以负数标记开头
+        long long head = 0;
+        std::memcpy(&head, &header, sizeof(head));
+        return (head < 0) ? static_cast<StorageType>(-head) : StorageType::Float64;
+    }
+
+    /// @brief 标准化方式：z-score以均值与标准差，min-max以最小值与极差，robust以中位数与四分位距
+    enum class Scaling { ZScore, MinMax, Robust };
+
+    /// @brief 各维度的统计量，由`DefaultDataSet::featureStats`单遍求得，方差为总体方差
+    struct FeatureStats {
+        long long count = 0;
+        std::vector<double> mean, variance, min, max;
+        /// @brief 近似的下四分位数、中位数与上四分位数，未要求估计时为空
+        std::vector<double> q1, median, q3;
     };
 
-    /// @brief 实现的基本数据集
+    /// @brief 实现的基本数据集，特征按行连续存放于对齐的缓冲区中。
+    /// `__T`为`float`时占用减半；为`int8_t`时由`convertFrom`按维度线性量化，
+    /// 各维度的偏移与缩放保存在数据集中，查询向量需以`encode`转换
     /// @tparam __T 向量中的数据类型
     /// @tparam __ST 标签的数据类型
     template<class __T, class __ST>
@@ -102,39 +486,173 @@ namespace knn {
         DefaultDataSet() = default;
         /// @brief 以给定维度初始化
         /// @param __dimension 维度
-        DefaultDataSet(long long __dimension) : data() {
+        DefaultDataSet(long long __dimension) : features(), label_ids() {
             dimension = __dimension;
             tot_samples = 0;
         }
         /// @brief 以提供的维度和总量初始化
         /// @param __dimension 维度
         /// @param __tot 总数据数
-        DefaultDataSet(long long __dimension, long long __tot) : data() {
+        DefaultDataSet(long long __dimension, long long __tot) : features(), label_ids() {
             dimension = __dimension;
             tot_samples = 0;
-            data.reserve(__tot);
+            reserve(__tot);
         }
         /// @brief 列表初始化
         /// @param __list 初始化列表
-        DefaultDataSet(const std::initializer_list<Record<__T, __ST>>& __list) : data() {
+        DefaultDataSet(const std::initializer_list<Record<__T, __ST>>& __list) : features(), label_ids() {
             dimension = __list.begin()->vec.size();
             tot_samples = 0;
-            for (auto it = __list.begin(); it != __list.end(); ++it, ++tot_samples) {
-                data.push_back(*it);
+            reserve(__list.size());
+            for (auto it = __list.begin(); it != __list.end(); ++it) {
+                appendRecord(*it);
             }
         }
         DefaultDataSet(const DefaultDataSet& __dataset) = default;
+
+        /// @brief 由另一储存类型的数据集转换，源数据集的z-score标准化随之保留。
+        ///        `int8_t`储存时每个维度以区间中点为偏移量化到`[-127, 127]`，标准化合并进量化的偏移与缩放
+        /// @param __source 源数据集
+        /// @param __per_dimension_scale 为`false`时各维度共用最大区间对应的缩放，距离的相对大小保持不变；
+        ///        为`true`时每个维度用满各自的区间，精度更高，但相当于对数据做了最小-最大归一化
+        template<class __U>
+        void convertFrom(const DefaultDataSet<__U, __ST>& __source, bool __per_dimension_scale = false) {
+            clear();
+            dimension = __source.dimension;
+            reserve(__source.tot_samples);
+            label_ids = __source.label_ids;
+            label_table = __source.label_table;
+            tot_samples = __source.tot_samples;
+            features.resize(tot_samples * dimension);
+            if constexpr (quantized) {
+                std::vector<double> low(dimension, std::numeric_limits<double>::max());
+                std::vector<double> high(dimension, std::numeric_limits<double>::lowest());
+                for (long long i = 0; i < tot_samples; ++i) {
+                    const __U* row = __source.rowPtr(i);
+                    for (long long j = 0; j < dimension; ++j) {
+                        low[j] = std::min(low[j], static_cast<double>(row[j]));
+                        high[j] = std::max(high[j], static_cast<double>(row[j]));
+                    }
+                }
+                // 量化参数以原始单位表示：源数据集标准化过时 x = z * a + u
+                q_offset.assign(dimension, 0.0);
+                q_scale.assign(dimension, 1.0);
+                std::vector<double> z_offset(dimension), z_scale(dimension);
+                double shared_range = 0.0;
+                for (long long j = 0; j < dimension && tot_samples > 0; ++j) {
+                    shared_range = std::max(shared_range, high[j] - low[j]);
+                }
+                for (long long j = 0; j < dimension; ++j) {
+                    const double range = (tot_samples <= 0) ? 0.0 : (__per_dimension_scale ? high[j] - low[j] : shared_range);
+                    z_offset[j] = (tot_samples > 0) ? (low[j] + high[j]) / 2 : 0.0;
+                    z_scale[j] = (range > 0) ? range / (2 * code_max) : 1.0;
+                    const double u = __source.normalized ? __source.__u[j] : 0.0;
+                    const double a = __source.normalized ? __source.__a[j] : 1.0;
+                    q_offset[j] = u + a * z_offset[j];
+                    q_scale[j] = a * z_scale[j];
+                }
+                for (long long i = 0; i < tot_samples; ++i) {
+                    const __U* row = __source.rowPtr(i);
+                    __T* out = features.data() + i * dimension;
+                    for (long long j = 0; j < dimension; ++j) {
+                        out[j] = quantize((static_cast<double>(row[j]) - z_offset[j]) / z_scale[j]);
+                    }
+                }
+                normalized = false;
+            } else {
+                const __U* source_begin = __source.featureData();
+                std::transform(source_begin, source_begin + tot_samples * dimension, features.begin(),
+                               [](const __U& x) { return static_cast<__T>(x); });
+                normalized = __source.normalized;
+                __u = __source.__u;
+                __a = __source.__a;
+            }
+        }
+
+        /// @brief 将原始单位的查询向量转换到该数据集的储存空间：同步标准化，`int8_t`储存时再量化
+        /// @param __vec 给定向量
+        /// @return 可直接用于查询的向量
+        template<class __U>
+        std::vector<__T> encode(const std::vector<__U>& __vec) const {
+            std::vector<__T> ret(__vec.size());
+            for (std::size_t i = 0; i < __vec.size(); ++i) {
+                double x = static_cast<double>(__vec[i]);
+                if constexpr (quantized) {
+                    if (i < q_scale.size()) x = (x - q_offset[i]) / q_scale[i];
+                    ret[i] = quantize(x);
+                } else {
+                    if (normalized) x = (x - __u[i]) / __a[i];
+                    ret[i] = static_cast<__T>(x);
+                }
+            }
+            return ret;
+        }
+
+        /// @brief 预留可容纳`__tot`条记录的空间
+        /// @param __tot 总数据数
+        void reserve(long long __tot) {
+            detachMapping();
+            features.reserve(__tot * dimension);
+            label_ids.reserve(__tot);
+        }
         
         /// @brief 添加数据记录
         /// @param __record 记录
         inline void appendRecord(const std::vector<__T>& __vec, const __ST __state) override {
-            tot_samples += 1;
-            data.push_back(Record<__T, __ST>{__vec, __state});
+            if (!dimension && !tot_samples) dimension = __vec.size();
+            appendRow(__vec.data(), __state, __vec.size());
         }
         inline void appendRecord(const Record<__T, __ST>& __record) override {
+            appendRecord(__record.vec, __record.state);
+        }
+        inline void appendRecord(const RecordView<__T, __ST>& __view) override {
+            if (!dimension && !tot_samples) dimension = __view.dimension;
+            appendRow(__view.vec, *__view.state, __view.dimension);
+        }
+
+        /// @brief 与`appendRecord`一致地确定维度：数据集为空且维度为0时采用`__dimension`
+        /// @return 数据集的维度是否等于`__dimension`，不等时不能以`emplaceRow`写入`__dimension`个特征
+        inline bool adoptDimension(long long __dimension) {
+            if (!dimension && !tot_samples) dimension = __dimension;
+            return dimension == __dimension;
+        }
+        /// @brief 追加一条特征全为零、尚无标签的记录，返回其特征的可写地址，供读取器直接写入。
+        ///        标签编号为`no_label_id`，须随后以`setLabel`或`setLabelId`设置
+        inline __T* emplaceRow() {
+            detachMapping();
+            features.resize(features.size() + dimension, __T{});
+            label_ids.push_back(no_label_id);
             tot_samples += 1;
-            data.push_back(__record);
+            return features.data() + (tot_samples - 1) * dimension;
+        }
+        /// @brief 一次追加`__n`条全零、尚无标签的记录，返回第一条的可写地址
+        inline __T* emplaceRows(long long __n) {
+            detachMapping();
+            features.resize(features.size() + __n * dimension, __T{});
+            label_ids.resize(label_ids.size() + __n, no_label_id);
+            tot_samples += __n;
+            return features.data() + (tot_samples - __n) * dimension;
+        }
+        /// @brief 设置第`__index`条记录的标签
+        inline void setLabel(long long __index, const __ST& __state) {
+            label_ids[__index] = label_table.intern(__state);
+        }
+        /// @brief 以标签编号设置第`__index`条记录的标签，编号须由`internLabel`取得。不修改标签表，可并发调用
+        inline void setLabelId(long long __index, std::uint32_t __label) {
+            label_ids[__index] = __label;
+        }
+        /// @brief 返回标签的编号，标签不存在时加入标签表
+        inline std::uint32_t internLabel(const __ST& __label) {
+            return label_table.intern(__label);
+        }
+        long long labelCount() const override {
+            return static_cast<long long>(label_table.size());
+        }
+        std::uint32_t findLabel(const __ST& __label) const override {
+            return label_table.find(__label);
         }
+        /// @brief 编号对应的标签
+        inline const __ST& labelOf(std::uint32_t __label) const { return label_table.at(__label); }
 
         void saveToBin(const char* __target) const {
             std::ofstream file_out(__target, std::ios::out | std::ios::binary);
@@ -142,77 +660,473 @@ namespace knn {
             file_out.close();
         }
 
-        void saveToBin(std::ofstream& file_out) const {
-            // Header
-            binaryWrite(tot_samples, file_out);
-            binaryWrite(dimension, file_out);
-            if constexpr (std::is_integral_v<__ST> || std::is_floating_point_v<__ST>) {
-                binaryWrite(false, file_out);
-                for (auto& rec : data) {
-                    for (auto& feature : rec.vec) {
-                        binaryWrite(feature, file_out);
-                    }
-                    binaryWrite(rec.state, file_out);
+        /// @brief 以第2版格式写入，特征块按流中的绝对位置对齐到64字节，便于映射后原地使用
+        /// @param __rows 为`false`时只写入维度与标准化参数，不含任何记录，供不需要原始向量的索引(如`IVFPQ`)保存
+        void saveToBin(std::ofstream& file_out, bool __rows = true) const {
+            const std::streamoff start = file_out.tellp();
+            const long long rows = __rows ? tot_samples : 0;
+            DataSetBinHeader header{};
+            std::memcpy(header.magic, bin_magic, sizeof(bin_magic));
+            header.version = bin_version;
+            header.endian = bin_endian;
+            header.dtype = static_cast<std::uint32_t>(storage_type_of<__T>);
+            header.dtype_size = sizeof(__T);
+            header.label_kind = arithmetic_label ? 0 : 1;
+            header.label_size = arithmetic_label ? sizeof(__ST) : 0;
+            header.tot_samples = rows;
+            header.dimension = dimension;
+            binaryWrite(header, file_out);
+            const char zeros[bin_align] = {};
+            file_out.write(zeros, (bin_align - static_cast<std::uint64_t>(file_out.tellp()) % bin_align) % bin_align);
+            // Features
+            header.feature_offset = file_out.tellp() - start;
+            file_out.write(reinterpret_cast<const char*>(featureData()), sizeof(__T) * rows * dimension);
+            // Labels
+            header.label_offset = file_out.tellp() - start;
+            if constexpr (arithmetic_label) {
+                std::vector<__ST> labels(rows);
+                for (long long i = 0; i < rows; ++i) {
+                    if (label_ids[i] != no_label_id) labels[i] = label_table.at(label_ids[i]);
+                }
+                file_out.write(reinterpret_cast<const char*>(labels.data()), sizeof(__ST) * rows);
+            } else {
+                // 直接写入标签表，每行只保存编号
+                const std::size_t label_cnt = __rows ? label_table.size() : 0;
+                binaryWrite(static_cast<std::uint32_t>(label_cnt), file_out);
+                for (std::size_t i = 0; i < label_cnt; ++i) {
+                    const __ST& label = label_table.at(static_cast<std::uint32_t>(i));
+                    binaryWrite(static_cast<std::uint32_t>(label.size()), file_out);
+                    file_out.write(label.data(), label.size());
                 }
+                file_out.write(reinterpret_cast<const char*>(label_ids.data()), sizeof(std::uint32_t) * rows);
+            }
+            // Stats
+            header.stats_offset = file_out.tellp() - start;
+            binaryWrite(static_cast<std::uint8_t>(normalized), file_out);
+            if (normalized) {
+                file_out.write(reinterpret_cast<const char*>(__u.data()), sizeof(double) * dimension);
+                file_out.write(reinterpret_cast<const char*>(__a.data()), sizeof(double) * dimension);
+            }
+            binaryWrite(static_cast<std::uint8_t>(!q_scale.empty()), file_out);
+            if (!q_scale.empty()) {
+                file_out.write(reinterpret_cast<const char*>(q_offset.data()), sizeof(double) * dimension);
+                file_out.write(reinterpret_cast<const char*>(q_scale.data()), sizeof(double) * dimension);
+            }
+            const std::streamoff end = file_out.tellp();
+            header.total_bytes = end - start;
+            file_out.seekp(start);
+            binaryWrite(header, file_out);
+            file_out.seekp(end);
+        }
+
+        /// @brief 映射二进制文件并原地使用其中的特征块，旧格式或无法映射时按流读取
+        void loadFromBin(const char* __source) {
+            loadFromBin(__source, 0);
+        }
+
+        /// @brief 映射二进制文件中从`__offset`开始的数据集，特征块不复制，修改数据集时才复制出来
+        /// @param __source 文件路径
+        /// @param __offset 数据集在文件中的起始偏移量
+        /// @return 数据集之后的偏移量，读取失败时为-1
+        long long loadFromBin(const char* __source, long long __offset) {
+            clear();
+            auto file = MappedFile::open(__source);
+            if (file == nullptr || __offset < 0 || file->size() < static_cast<std::size_t>(__offset) + sizeof(DataSetBinHeader)
+                || std::memcmp(file->data() + __offset, bin_magic, sizeof(bin_magic)) != 0) {
+                std::ifstream fin(__source, std::ios::in | std::ios::binary);
+                fin.seekg(__offset);
+                loadFromBin(fin);
+                return fin ? static_cast<long long>(fin.tellg()) : -1;
+            }
+            const char* base = file->data() + __offset;
+            DataSetBinHeader header;
+            std::memcpy(&header, base, sizeof(header));
+            if (!acceptHeader(header) || header.total_bytes > file->size() - static_cast<std::size_t>(__offset)) return -1;
+            dimension = header.dimension;
+            tot_samples = header.tot_samples;
+            if (!parseTail(header, base + header.label_offset, base + header.total_bytes)) {
+                clear();
+                return -1;
+            }
+            // 写入时按绝对位置对齐，数据集所在的偏移量与写入时不同才需要复制
+            const char* block = base + header.feature_offset;
+            if (reinterpret_cast<std::uintptr_t>(block) % alignof(__T) == 0) {
+                mapped = reinterpret_cast<const __T*>(block);
+                mapping = std::move(file);
             } else {
-                binaryWrite(true, file_out);
-                std::unordered_map<std::string, int> tags;
-                int tag_id = 0;
-                for (auto& element : data) {
-                    auto it = tags.find(element.state);
-                    if (it == tags.end()) {
-                        tags.insert(std::make_pair(element.state, tag_id));
-                        tag_id += 1;
+                features.resize(tot_samples * dimension);
+                std::memcpy(features.data(), block, sizeof(__T) * features.size());
+            }
+            return __offset + static_cast<long long>(header.total_bytes);
+        }
+
+        /// @brief 从流中读取，第2版格式的特征块一次读入；结束后流位于数据集之后
+        void loadFromBin(std::ifstream& fin) {
+            clear();
+            const std::streamoff start = fin.tellg();
+            DataSetBinHeader header;
+            fin.read(reinterpret_cast<char*>(&header), sizeof(header));
+            if (!fin || std::memcmp(header.magic, bin_magic, sizeof(bin_magic)) != 0) {
+                fin.clear();
+                fin.seekg(start);
+                loadLegacy(fin);
+                return;
+            }
+            if (!acceptHeader(header)) {
+                fin.seekg(start + static_cast<std::streamoff>(header.total_bytes));
+                return;
+            }
+            dimension = header.dimension;
+            tot_samples = header.tot_samples;
+            features.resize(tot_samples * dimension);
+            fin.seekg(start + static_cast<std::streamoff>(header.feature_offset));
+            fin.read(reinterpret_cast<char*>(features.data()), sizeof(__T) * features.size());
+            std::vector<char> tail(header.total_bytes - header.label_offset);
+            fin.read(tail.data(), tail.size());
+            if (!fin || !parseTail(header, tail.data(), tail.data() + tail.size())) clear();
+        }
+
+        /// @brief 单遍求各维度的均值、方差与最值，可选地估计四分位数。
+        ///        各块按行以Welford法累计，再以Chan等人的公式合并；
+        ///        四分位数由等间隔抽取的至多`__sample`行估计
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        /// @param __quantiles 是否估计四分位数
+        /// @param __sample 估计四分位数时抽取的最大行数
+        FeatureStats featureStats(int thread_cnt = -1, bool __quantiles = false, long long __sample = 65536) const {
+            FeatureStats ret;
+            const long long dim = dimension;
+            ret.count = tot_samples;
+            ret.mean.assign(dim, 0.0);
+            ret.variance.assign(dim, 0.0);
+            ret.min.assign(dim, 0.0);
+            ret.max.assign(dim, 0.0);
+            if (__quantiles) {
+                ret.q1.assign(dim, 0.0);
+                ret.median.assign(dim, 0.0);
+                ret.q3.assign(dim, 0.0);
+            }
+            if (tot_samples <= 0 || dim <= 0) return ret;
+
+            // 第stride的整数倍行被抽取，按维度存放：samples[j * sample_cnt + s]
+            const long long stride = __quantiles ? std::max(1LL, (tot_samples + __sample - 1) / std::max(1LL, __sample)) : 0;
+            const long long sample_cnt = __quantiles ? (tot_samples + stride - 1) / stride : 0;
+            std::vector<double> samples(sample_cnt * dim);
+
+            struct Partial {
+                long long n = 0;
+                std::vector<double> mean, m2, low, high;
+            };
+            const long long chunk_cnt = chunkCount(thread_cnt);
+            std::vector<Partial> parts(chunk_cnt);
+            forRowChunks(chunk_cnt, [&](long long c, long long left, long long right) {
+                Partial& p = parts[c];
+                p.mean.assign(dim, 0.0);
+                p.m2.assign(dim, 0.0);
+                p.low.assign(dim, std::numeric_limits<double>::infinity());
+                p.high.assign(dim, -std::numeric_limits<double>::infinity());
+                double* mean = p.mean.data();
+                double* m2 = p.m2.data();
+                double* low = p.low.data();
+                double* high = p.high.data();
+                long long next = stride ? (left + stride - 1) / stride * stride : right;
+                for (long long i = left; i < right; ++i) {
+                    const __T* row = rowPtr(i);
+                    const double inv = 1.0 / static_cast<double>(++p.n);
+                    for (long long j = 0; j < dim; ++j) {
+                        const double x = static_cast<double>(row[j]);
+                        const double delta = x - mean[j];
+                        mean[j] += delta * inv;
+                        m2[j] += delta * (x - mean[j]);
+                        low[j] = std::min(low[j], x);
+                        high[j] = std::max(high[j], x);
                     }
+                    if (i == next) {
+                        double* out = samples.data() + i / stride;
+                        for (long long j = 0; j < dim; ++j) out[j * sample_cnt] = static_cast<double>(row[j]);
+                        next += stride;
+                    }
+                }
+            });
+
+            Partial& total = parts[0];
+            for (long long c = 1; c < chunk_cnt; ++c) {
+                const Partial& p = parts[c];
+                if (p.n == 0) continue;
+                const double n = static_cast<double>(total.n + p.n);
+                const double wa = static_cast<double>(total.n), wb = static_cast<double>(p.n);
+                for (long long j = 0; j < dim; ++j) {
+                    const double delta = p.mean[j] - total.mean[j];
+                    total.mean[j] += delta * wb / n;
+                    total.m2[j] += p.m2[j] + delta * delta * wa * wb / n;
+                    total.low[j] = std::min(total.low[j], p.low[j]);
+                    total.high[j] = std::max(total.high[j], p.high[j]);
                 }
-                binaryWrite((int)tags.size(), file_out);
-                for (auto& tag : tags) {
-                    binaryWrite((int)tag.first.size(), file_out);
-                    file_out.write(tag.first.c_str(), tag.first.size());
-                    binaryWrite(tag.second, file_out);
+                total.n += p.n;
+            }
+            for (long long j = 0; j < dim; ++j) {
+                ret.mean[j] = total.mean[j];
+                ret.variance[j] = total.m2[j] / static_cast<double>(total.n);
+                ret.min[j] = total.low[j];
+                ret.max[j] = total.high[j];
+            }
+            for (long long j = 0; j < dim && __quantiles; ++j) {
+                double* column = samples.data() + j * sample_cnt;
+                ret.q1[j] = sampleQuantile(column, sample_cnt, 0.25);
+                ret.median[j] = sampleQuantile(column, sample_cnt, 0.5);
+                ret.q3[j] = sampleQuantile(column, sample_cnt, 0.75);
+            }
+            return ret;
+        }
+
+        /// @brief 按`__method`标准化：先单遍求统计量，再以一遍按行的扫描完成变换。
+        ///        极差或尺度为0的维度只做平移；已标准化过时与原有变换复合，`syncNormalization`仍以原始单位为输入。
+        ///        复合后的平移与缩放以`double`保存；`int8_t`储存的量化参数在转换时已确定，不可再标准化
+        /// @param __method 标准化方式
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        void normalize(Scaling __method, int thread_cnt = -1) {
+            static_assert(!quantized, "int8_t storage cannot be normalized, normalize the source before convertFrom");
+            const FeatureStats stats = featureStats(thread_cnt, __method == Scaling::Robust);
+            std::vector<double> shift(dimension), inv(dimension), u(dimension), a(dimension);
+            for (long long j = 0; j < dimension; ++j) {
+                double scale;
+                switch (__method) {
+                    case Scaling::MinMax:
+                        shift[j] = stats.min[j];
+                        scale = stats.max[j] - stats.min[j];
+                        break;
+                    case Scaling::Robust:
+                        shift[j] = stats.median[j];
+                        scale = stats.q3[j] - stats.q1[j];
+                        break;
+                    default:
+                        shift[j] = stats.mean[j];
+                        scale = std::sqrt(stats.variance[j]);
+                        break;
                 }
-                for (auto& rec : data) {
-                    for (auto& feature : rec.vec) {
-                        binaryWrite(feature, file_out);
+                if (!(scale > 0)) scale = 1.0;
+                inv[j] = 1.0 / scale;
+                const double u_old = normalized ? __u[j] : 0.0;
+                const double a_old = normalized ? __a[j] : 1.0;
+                u[j] = u_old + a_old * shift[j];
+                a[j] = a_old * scale;
+            }
+            detachMapping();
+            const long long dim = dimension;
+            __T* rows = features.data();
+            const double* sp = shift.data();
+            const double* ip = inv.data();
+            forRowChunks(chunkCount(thread_cnt), [&](long long, long long left, long long right) {
+                for (long long i = left; i < right; ++i) {
+                    __T* row = rows + i * dim;
+                    for (long long j = 0; j < dim; ++j) {
+                        row[j] = static_cast<__T>((static_cast<double>(row[j]) - sp[j]) * ip[j]);
                     }
-                    binaryWrite(tags[rec.state], file_out);
                 }
+            });
+            __u.swap(u);
+            __a.swap(a);
+            normalized = true;
+        }
+
+        /// @brief z-score法标准化
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        void zScoreNormalization(int thread_cnt = -1) { normalize(Scaling::ZScore, thread_cnt); }
+        /// @brief min-max法标准化，各维度缩放至`[0, 1]`
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        void minMaxNormalization(int thread_cnt = -1) { normalize(Scaling::MinMax, thread_cnt); }
+        /// @brief 以中位数与四分位距标准化，受离群值的影响较小
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        void robustNormalization(int thread_cnt = -1) { normalize(Scaling::Robust, thread_cnt); }
+
+        /// @brief 将给定的向量与该数据集的标准化同步
+        /// @param __vec 给定向量
+        /// @return 标准化后的向量
+        std::vector<__T> syncNormalization(const std::vector<__T>& __vec) const override {
+            if (!normalized) return __vec;
+            std::vector<__T> temp;
+            temp.reserve(__vec.size());
+            for (std::size_t i = 0; i < __vec.size(); ++i) {
+                temp.push_back(static_cast<__T>((static_cast<double>(__vec[i]) - __u[i]) / __a[i]));
             }
-            if (normalized) {
-                binaryWrite(true, file_out);
-                for (auto ele_u : __u) binaryWrite(ele_u, file_out);
-                for (auto ele_a : __a) binaryWrite(ele_a, file_out);
-            } else {
-                binaryWrite(false, file_out);
+            return temp;
+        }
+
+        void clear() override {
+            features.clear();
+            mapped = nullptr;
+            mapping.reset();
+            label_ids.clear();
+            label_table.clear();
+            tot_samples = 0;
+            normalized = false;
+            __u.clear();
+            __a.clear();
+            q_offset.clear();
+            q_scale.clear();
+        }
+
+        RecordView<__T, __ST> getRef(long long __index) const override {
+            const std::uint32_t label = label_ids[__index];
+            const __ST* state = (label == no_label_id) ? nullptr : &label_table.at(label);
+            return RecordView<__T, __ST>{rowPtr(__index), state, dimension, __index, label};
+        }
+        const __T* featureData() const override {
+            return (mapped != nullptr) ? mapped : features.data();
+        }
+        /// @brief 返回第`__index`行特征的首地址
+        inline const __T* rowPtr(long long __index) const {
+            return featureData() + __index * dimension;
+        }
+        /// @brief 特征块是否仍直接位于映射的文件中
+        inline bool isMapped() const { return mapped != nullptr; }
+
+        long long getDimension() const override {
+            return this->dimension;
+        }
+        long long dataSize() const override {
+            return this->tot_samples;
+        }
+
+        /// @brief `int8_t`储存时每个维度的偏移与缩放，原始值约为`code * q_scale + q_offset`
+        inline const std::vector<double>& quantOffset() const { return q_offset; }
+        inline const std::vector<double>& quantScale() const { return q_scale; }
+
+        private:
+        template<class, class> friend class DefaultDataSet;
+        /// @brief 按线程数决定按行切分的块数，块数多于线程数以便窃取平衡各块耗时
+        long long chunkCount(int thread_cnt) const {
+            return (thread_cnt <= 1) ? 1 : std::max(1LL, std::min<long long>(tot_samples, 4LL * thread_cnt));
+        }
+        /// @brief 将`[0, tot_samples)`按行切分为`__chunk_cnt`块交给`__func(c, left, right)`，
+        ///        多于一块时各块作为任务提交至全局线程池
+        template<class __F>
+        void forRowChunks(long long __chunk_cnt, __F&& __func) const {
+            const long long unit = (tot_samples + __chunk_cnt - 1) / __chunk_cnt;
+            if (__chunk_cnt <= 1) {
+                __func(0LL, 0LL, tot_samples);
+                return;
             }
+            ThreadPool& pool = ThreadPool::global();
+            std::vector<std::future<void>> rets;
+            rets.reserve(__chunk_cnt);
+            for (long long c = 0; c < __chunk_cnt; ++c) {
+                const long long left = std::min(tot_samples, c * unit);
+                const long long right = std::min(tot_samples, left + unit);
+                rets.push_back(pool.submit([&__func, c, left, right]() { __func(c, left, right); }));
+            }
+            for (auto& ret : rets) pool.wait(ret);
+        }
+        /// @brief 以线性插值求样本的`__p`分位数，`__begin`中的次序被打乱
+        static double sampleQuantile(double* __begin, long long __n, double __p) {
+            const double pos = __p * static_cast<double>(__n - 1);
+            const long long lo = static_cast<long long>(pos);
+            std::nth_element(__begin, __begin + lo, __begin + __n);
+            double ret = __begin[lo];
+            if (lo + 1 < __n) ret += (pos - lo) * (*std::min_element(__begin + lo + 1, __begin + __n) - ret);
+            return ret;
         }
 
-        void loadFromBin(const char* __source) {
-            std::ifstream fin(__source, std::ios::in | std::ios::binary);
-            loadFromBin(fin);
-            fin.close();
+        static constexpr bool quantized = std::is_same_v<__T, std::int8_t>;
+        static constexpr bool arithmetic_label = std::is_integral_v<__ST> || std::is_floating_point_v<__ST>;
+        static constexpr double code_max = 127.0;
+        static inline __T quantize(double __x) {
+            return static_cast<__T>(std::lround(std::max(-code_max, std::min(code_max, __x))));
         }
 
-        void loadFromBin(std::ifstream& fin) {
+        /// @brief 检查文件头能否由该数据集读取
+        static bool acceptHeader(const DataSetBinHeader& __header) {
+            return (__header.version == 2 || __header.version == bin_version) && __header.endian == bin_endian
+                && __header.dtype == static_cast<std::uint32_t>(storage_type_of<__T>)
+                && __header.dtype_size == sizeof(__T)
+                && __header.label_kind == (arithmetic_label ? 0u : 1u)
+                && __header.label_size == (arithmetic_label ? sizeof(__ST) : 0u)
+                && __header.tot_samples >= 0 && __header.dimension >= 0
+                && __header.feature_offset + sizeof(__T) * __header.tot_samples * __header.dimension <= __header.label_offset
+                && __header.label_offset <= __header.stats_offset && __header.stats_offset <= __header.total_bytes;
+        }
+
+        /// @brief 解析特征块之后的标签与标准化参数
+        /// @param __header 文件头，`dimension`与`tot_samples`须已设置
+        /// @param __begin 标签块起点
+        /// @param __end 数据集末尾
+        bool parseTail(const DataSetBinHeader& __header, const char* __begin, const char* __end) {
+            const char* cur = __begin;
+            auto take = [&](void* __dst, std::size_t __bytes) {
+                if (static_cast<std::size_t>(__end - cur) < __bytes) return false;
+                if (__bytes > 0) std::memcpy(__dst, cur, __bytes);
+                cur += __bytes;
+                return true;
+            };
+            label_ids.resize(tot_samples);
+            if constexpr (arithmetic_label) {
+                std::vector<__ST> labels(tot_samples);
+                if (!take(labels.data(), sizeof(__ST) * tot_samples)) return false;
+                for (long long i = 0; i < tot_samples; ++i) label_ids[i] = label_table.intern(labels[i]);
+            } else {
+                std::uint32_t table_size;
+                if (!take(&table_size, sizeof(table_size))) return false;
+                // 文件中的编号经`remap`转换为标签表中的编号，表中有重复标签时同样正确
+                std::vector<std::uint32_t> remap(table_size);
+                __ST label;
+                for (auto& id : remap) {
+                    std::uint32_t length;
+                    if (!take(&length, sizeof(length)) || static_cast<std::size_t>(__end - cur) < length) return false;
+                    label.assign(cur, length);
+                    cur += length;
+                    id = label_table.intern(label);
+                }
+                if (!take(label_ids.data(), sizeof(std::uint32_t) * tot_samples)) return false;
+                for (auto& id : label_ids) {
+                    if (id >= table_size) return false;
+                    id = remap[id];
+                }
+            }
+            cur = __begin + (__header.stats_offset - __header.label_offset);
+            std::uint8_t flag;
+            if (!take(&flag, sizeof(flag))) return false;
+            normalized = flag != 0;
+            if (normalized && __header.version >= 3) {
+                __u.resize(dimension);
+                __a.resize(dimension);
+                if (!take(__u.data(), sizeof(double) * dimension) || !take(__a.data(), sizeof(double) * dimension)) return false;
+            } else if (normalized) {
+                std::vector<__T> u(dimension), a(dimension);
+                if (!take(u.data(), sizeof(__T) * dimension) || !take(a.data(), sizeof(__T) * dimension)) return false;
+                __u.assign(u.begin(), u.end());
+                __a.assign(a.begin(), a.end());
+            }
+            if (!take(&flag, sizeof(flag))) return false;
+            if (flag != 0) {
+                q_offset.resize(dimension);
+                q_scale.resize(dimension);
+                if (!take(q_offset.data(), sizeof(double) * dimension) || !take(q_scale.data(), sizeof(double) * dimension)) return false;
+            }
+            return true;
+        }
+
+        /// @brief 读取没有文件头的旧格式
+        void loadLegacy(std::ifstream& fin) {
+            // 储存类型与该数据集不一致时不读取
+            if (peekStorageType(fin) != storage_type_of<__T>) return;
+            if constexpr (storage_type_of<__T> != StorageType::Float64) {
+                long long tag;
+                binaryRead(tag, fin);
+            }
             // Header
-            binaryRead(tot_samples, fin);
+            long long file_samples;
+            binaryRead(file_samples, fin);
             binaryRead(dimension, fin);
             bool state_type;
             binaryRead(state_type, fin);
-            data.reserve(tot_samples);
-            std::vector<__T> features;
+            features.resize(file_samples * dimension);
+            label_ids.reserve(file_samples);
+            const std::streamsize row_bytes = sizeof(__T) * dimension;
             if constexpr (std::is_integral_v<__ST> || std::is_floating_point_v<__ST>) {
-                for (int i = 0; i < tot_samples; ++i) {
-                    features.clear();
-                    features.reserve(dimension);
-                    for (int j = 0; j < dimension; ++j) {
-                        __T x;
-                        binaryRead(x, fin);
-                        features.push_back(x);
-                    }
+                for (long long i = 0; i < file_samples; ++i) {
+                    fin.read(reinterpret_cast<char*>(features.data() + i * dimension), row_bytes);
                     __ST s;
                     binaryRead(s, fin);
-                    data.push_back({features, s});
+                    label_ids.push_back(label_table.intern(s));
                 }
             } else {
                 std::unordered_map<int, std::string> tags;
@@ -229,19 +1143,14 @@ namespace knn {
                     tags.insert(std::make_pair(s_size, x));
                     delete[] temp;
                 }
-                for (int i = 0; i < tot_samples; ++i) {
-                    features.clear();
-                    features.reserve(dimension);
-                    for (int j = 0; j < dimension; ++j) {
-                        __T x;
-                        binaryRead(x, fin);
-                        features.push_back(x);
-                    }
+                for (long long i = 0; i < file_samples; ++i) {
+                    fin.read(reinterpret_cast<char*>(features.data() + i * dimension), row_bytes);
                     int s;
                     binaryRead(s, fin);
-                    data.push_back({features, tags[s]});
+                    label_ids.push_back(label_table.intern(tags[s]));
                 }
             }
+            tot_samples = file_samples;
             binaryRead(normalized, fin);
             if (normalized) {
                 __u.reserve(dimension);
@@ -249,73 +1158,42 @@ namespace knn {
                 __T temp_data;
                 for (int i = 0; i < dimension; ++i) {
                     binaryRead(temp_data, fin);
-                    __u.push_back(temp_data);
+                    __u.push_back(static_cast<double>(temp_data));
                 }
                 for (int i = 0; i < dimension; ++i) {
                     binaryRead(temp_data, fin);
-                    __a.push_back(temp_data);
+                    __a.push_back(static_cast<double>(temp_data));
                 }
             }
-        }
-
-        /// @brief z-score法标准化
-        void zScoreNormalization() {
-            normalized = true;
-            __u.reserve(dimension);
-            __a.reserve(dimension);
-            for (int dim = 0; dim < dimension; ++dim) {
-                double __mean = 0.0, __std_o = 0.0;
-                for (int i = 0; i < tot_samples; ++i) {
-                    __mean += data[i].vec[dim];
-                }
-                __mean /= static_cast<double>(tot_samples);
-                __u.push_back(static_cast<__T>(__mean));
-                for (int i = 0; i < tot_samples; ++i) {
-                    __std_o += (data[i].vec[dim] - __mean) * (data[i].vec[dim] - __mean);
-                }
-                __std_o /= static_cast<double>(tot_samples);
-                __std_o = std::sqrt(__std_o);
-                __a.push_back(static_cast<__T>(__std_o));
-
-                for (int i = 0; i < tot_samples; ++i) {
-                    data[i].vec[dim] = (data[i].vec[dim] - __mean) / __std_o;
+            if constexpr (quantized) {
+                bool has_scale;
+                binaryRead(has_scale, fin);
+                if (has_scale) {
+                    q_offset.resize(dimension);
+                    q_scale.resize(dimension);
+                    for (auto& x : q_offset) binaryRead(x, fin);
+                    for (auto& x : q_scale) binaryRead(x, fin);
                 }
             }
         }
 
-        /// @brief 将给定的向量与该数据集的标准化同步
-        /// @param __vec 给定向量
-        /// @return 标准化后的向量
-        std::vector<__T> syncNormalization(const std::vector<__T>& __vec) const override {
-            if (!normalized) return __vec;
-            std::vector<__T> temp;
-            temp.reserve(__vec.size());
-            for (int i = 0; i < __vec.size(); ++i) {
-                temp.push_back((__vec[i] - __u[i]) / __a[i]);
-            }
-            return temp;
-        }
-
-        void clear() override {
-            data.clear();
-            tot_samples = 0;
-        }
-
-        Record<__T, __ST>* getRef(long long __index) override {
-            return &data.at(__index);
-        }
-        const Record<__T, __ST>* getRef(long long __index) const override {
-            return &data.at(__index);
+        /// @brief 特征仍在映射中时复制到自有的缓冲区，之后才可修改
+        inline void detachMapping() {
+            if (mapped == nullptr) return;
+            features.assign(mapped, mapped + tot_samples * dimension);
+            mapped = nullptr;
+            mapping.reset();
         }
 
-        long long getDimension() const override {
-            return this->dimension;
-        }
-        long long dataSize() const override {
-            return this->tot_samples;
+        inline void appendRow(const __T* __row, const __ST& __state, long long __size) {
+            detachMapping();
+            long long copied = std::min(__size, dimension);
+            features.insert(features.end(), __row, __row + copied);
+            if (copied < dimension) features.resize(features.size() + dimension - copied, __T{});
+            label_ids.push_back(label_table.intern(__state));
+            tot_samples += 1;
         }
 
-        private:
         template<class __WT>
         void binaryWrite(const __WT& __data, std::ofstream& __ofs) const {
             const char* x = reinterpret_cast<const char*>(&__data);
@@ -323,379 +1201,3083 @@ namespace knn {
         }
         template<class __RT>
         void binaryRead(__RT& __val, std::ifstream& __ifs) const {
-            char* x = new char[sizeof(__RT)];
-            __ifs.read(x, sizeof(__RT));
-            __val = *reinterpret_cast<__RT*>(x);
-            delete[] x;
+            __ifs.read(reinterpret_cast<char*>(&__val), sizeof(__RT));
         }
 
         bool normalized = false;
-        std::vector<__T> __u, __a;
-        std::vector< Record<__T, __ST> > data;
-        long long dimension, tot_samples;
+        /// @brief 标准化的平移与缩放，原始值为`x * __a + __u`
+        std::vector<double> __u, __a;
+        std::vector<double> q_offset, q_scale;
+        std::vector<__T, AlignedAllocator<__T>> features;
+        /// @brief 映射加载时特征块位于`mapping`中，`features`为空
+        std::shared_ptr<const MappedFile> mapping;
+        const __T* mapped = nullptr;
+        /// @brief 每条记录的标签编号，标签本身只在`label_table`中保存一份
+        std::vector<std::uint32_t> label_ids;
+        LabelTable<__ST> label_table;
+        long long dimension = 0, tot_samples = 0;
     };
 
-    /// @brief 一致的权重
-    template<class __T, class __DT>
-    __DT uniformWeight(__DT distance, const std::vector<__T>* __record) {
-        return distance;
-    }
+    /// @brief 以下标列表引用另一数据集中部分记录的数据集，不复制特征与标签。
+    /// 第i条记录为源数据集的第`indices[i]`条记录，源数据集须在视图使用期间保持有效且不被修改。
+    /// 追加的记录保存在视图自身的`DefaultDataSet`中，排在引用的记录之后
+    /// @tparam __T 向量中的数据类型
+    /// @tparam __ST 标签的数据类型
+    template<class __T, class __ST>
+    class DataSetView : public DataSet<__T, __ST> {
+        public:
+        /// @param __source 源数据集
+        /// @param __indices 引用的记录在源数据集中的下标
+        DataSetView(const DataSet<__T, __ST>& __source, std::vector<long long> __indices)
+            : source(&__source), indices(std::move(__indices)), appended(__source.getDimension()) {}
+        /// @brief 引用`__indices[__begin, __end)`
+        DataSetView(const DataSet<__T, __ST>& __source, const std::vector<long long>& __indices,
+                    long long __begin, long long __end)
+            : source(&__source), indices(__indices.begin() + __begin, __indices.begin() + __end),
+              appended(__source.getDimension()) {}
 
-    /// @brief 欧氏距离
-    template<class __T, class __DT>
-    __DT euclidean(const std::vector<__T>* __record, const std::vector<__T>* __sample) {
-        __DT dis{0}, x, z;
-        for (auto it = __record->begin(), sit = __sample->begin(); 
-            it != __record->end() && sit != __sample->end(); ++it, ++sit) {
-            x = static_cast<__DT>(*it); z = static_cast<__DT>(*sit);
-            z -= x; z *= z; dis += z;
-        }
-        return std::sqrt(dis);
-    }
-    /// @brief 曼哈顿距离
-    template<class __T, class __DT>
-    __DT manhattan(const std::vector<__T>* __record, const std::vector<__T>* __sample) {
-        __DT dis{0};
-        for (auto it = __record->begin(), sit = __sample->begin();
-            it != __record->end() && sit != __record->end(); ++it, ++sit) {
-                dis += std::abs(static_cast<__DT>(*it - *sit));
+        RecordView<__T, __ST> getRef(long long __index) const override {
+            const long long referenced = static_cast<long long>(indices.size());
+            if (__index < referenced) {
+                RecordView<__T, __ST> view = source->getRef(indices[__index]);
+                view.index = __index;
+                return view;
+            }
+            RecordView<__T, __ST> view = appended.getRef(__index - referenced);
+            view.index = __index;
+            view.label = findLabel(*view.state);
+            return view;
         }
-        return dis;
-    }
-
-    template<class __T, class __DT, class __ST>
-    class BaseKNN {
-        public:
-        virtual void get(const std::vector<__T>& __vec, int k,
-                        std::vector<const Record<__T, __ST>*>& __container) = 0;
-        virtual void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
-                                    std::vector<const Record<__T, __ST>*>& __container) = 0;
-        std::vector<const Record<__T, __ST>*> getResultContainer() {
-            return std::vector<const Record<__T, __ST>*>();
+        long long getDimension() const override { return source->getDimension(); }
+        long long dataSize() const override {
+            return static_cast<long long>(indices.size()) + appended.dataSize();
         }
-        virtual const DataSet<__T, __ST>* getDatasetRef() const = 0;
-    };
-
+        inline void appendRecord(const std::vector<__T>& __vec, const __ST __state) override {
+            appended.appendRecord(__vec, __state);
+        }
+        inline void appendRecord(const Record<__T, __ST>& __record) override {
+            appended.appendRecord(__record);
+        }
+        inline void appendRecord(const RecordView<__T, __ST>& __view) override {
+            appended.appendRecord(__view);
+        }
+        /// @brief 清空引用与追加的记录，源数据集不受影响
+        void clear() override {
+            indices.clear();
+            appended.clear();
+        }
+        /// @brief 与源数据集的归一化一致
+        std::vector<__T> syncNormalization(const std::vector<__T>& __vec) const override {
+            return source->syncNormalization(__vec);
+        }
+        /// @brief 沿用源数据集的标签编号，追加记录中源数据集没有的标签编号排在其后；源数据集不对标签编号时同样不编号
+        long long labelCount() const override {
+            const long long base = source->labelCount();
+            return (base > 0) ? base + appended.labelCount() : 0;
+        }
+        std::uint32_t findLabel(const __ST& __label) const override {
+            const long long base = source->labelCount();
+            if (base <= 0) return no_label_id;
+            std::uint32_t id = source->findLabel(__label);
+            if (id != no_label_id) return id;
+            id = appended.findLabel(__label);
+            return (id != no_label_id) ? static_cast<std::uint32_t>(base + id) : no_label_id;
+        }
+
+        inline const DataSet<__T, __ST>& getSource() const { return *source; }
+        inline const std::vector<long long>& getIndices() const { return indices; }
+
+        private:
+        const DataSet<__T, __ST>* source;
+        std::vector<long long> indices;
+        DefaultDataSet<__T, __ST> appended;
+    };
+
+    /// @brief 一致的权重
+    template<class __T, class __DT>
+    __DT uniformWeight(__DT distance, const __T* __record, long long __dimension) {
+        return distance;
+    }
+
+    /// @brief 欧氏距离，`__T`与`__DT`同为`float`或`double`时使用向量化内核，
+    ///        `float`储存配合`double`距离或`int8`储存时使用加宽累加的向量化内核
+    template<class __T, class __DT>
+    __DT euclidean(const __T* __record, const __T* __sample, long long __dimension) {
+        if constexpr (std::is_same_v<__T, __DT> && simd::has_kernel<__T>) {
+            return std::sqrt(simd::squaredL2(__record, __sample, __dimension));
+        } else if constexpr (simd::has_wide_kernel<__T, __DT>) {
+            return static_cast<__DT>(std::sqrt(static_cast<double>(simd::squaredL2Wide(__record, __sample, __dimension))));
+        } else {
+            __DT dis{0}, x, z;
+            for (long long i = 0; i < __dimension; ++i) {
+                x = static_cast<__DT>(__record[i]); z = static_cast<__DT>(__sample[i]);
+                z -= x; z *= z; dis += z;
+            }
+            return std::sqrt(dis);
+        }
+    }
+    /// @brief 欧氏距离的平方，不开方，只用于比较远近
+    template<class __T, class __DT>
+    __DT squaredEuclidean(const __T* __record, const __T* __sample, long long __dimension) {
+        if constexpr (std::is_same_v<__T, __DT> && simd::has_kernel<__T>) {
+            return simd::squaredL2(__record, __sample, __dimension);
+        } else if constexpr (simd::has_wide_kernel<__T, __DT>) {
+            return static_cast<__DT>(simd::squaredL2Wide(__record, __sample, __dimension));
+        } else {
+            __DT dis{0}, z;
+            for (long long i = 0; i < __dimension; ++i) {
+                z = static_cast<__DT>(__sample[i]) - static_cast<__DT>(__record[i]);
+                dis += z * z;
+            }
+            return dis;
+        }
+    }
+    /// @brief 曼哈顿距离，向量化规则同`euclidean`
+    template<class __T, class __DT>
+    __DT manhattan(const __T* __record, const __T* __sample, long long __dimension) {
+        if constexpr (std::is_same_v<__T, __DT> && simd::has_kernel<__T>) {
+            return simd::l1(__record, __sample, __dimension);
+        } else if constexpr (simd::has_wide_kernel<__T, __DT>) {
+            return static_cast<__DT>(simd::l1Wide(__record, __sample, __dimension));
+        } else {
+            __DT dis{0};
+            for (long long i = 0; i < __dimension; ++i) {
+                dis += std::abs(static_cast<__DT>(__record[i]) - static_cast<__DT>(__sample[i]));
+            }
+            return dis;
+        }
+    }
+
+    /// @brief 余弦距离`1 - cos`，任一向量为零向量时为1
+    template<class __T, class __DT>
+    __DT cosine(const __T* __record, const __T* __sample, long long __dimension) {
+        __DT dot{0}, norm_r{0}, norm_s{0}, x, z;
+        for (long long i = 0; i < __dimension; ++i) {
+            x = static_cast<__DT>(__record[i]); z = static_cast<__DT>(__sample[i]);
+            dot += x * z; norm_r += x * x; norm_s += z * z;
+        }
+        if (norm_r <= __DT{0} || norm_s <= __DT{0}) return __DT{1};
+        return __DT{1} - dot / static_cast<__DT>(std::sqrt(norm_r * norm_s));
+    }
+
+    /* 可分解的距离策略提供`term`与`fromTerms`：距离为各坐标轴`term(差值)`之和经`fromTerms`变换的结果，
+       KD树据此增量计算查询点到超矩形的距离下界用于剪枝；未提供时KD树不剪枝 */
+
+    /// @brief 欧氏距离策略
+    struct Euclidean {
+        template<class __DT, class __T>
+        inline __DT distance(const __T* __record, const __T* __sample, long long __dimension) const {
+            return euclidean<__T, __DT>(__record, __sample, __dimension);
+        }
+        template<class __DT>
+        inline __DT term(__DT __diff) const { return __diff * __diff; }
+        template<class __DT>
+        inline __DT fromTerms(__DT __sum) const { return static_cast<__DT>(std::sqrt(__sum)); }
+    };
+    /// @brief 平方欧氏距离策略，排序结果与`Euclidean`一致但省去开方
+    struct SquaredEuclidean {
+        template<class __DT, class __T>
+        inline __DT distance(const __T* __record, const __T* __sample, long long __dimension) const {
+            return squaredEuclidean<__T, __DT>(__record, __sample, __dimension);
+        }
+        template<class __DT>
+        inline __DT term(__DT __diff) const { return __diff * __diff; }
+        template<class __DT>
+        inline __DT fromTerms(__DT __sum) const { return __sum; }
+    };
+    /// @brief 曼哈顿距离策略
+    struct Manhattan {
+        template<class __DT, class __T>
+        inline __DT distance(const __T* __record, const __T* __sample, long long __dimension) const {
+            return manhattan<__T, __DT>(__record, __sample, __dimension);
+        }
+        template<class __DT>
+        inline __DT term(__DT __diff) const { return std::abs(__diff); }
+        template<class __DT>
+        inline __DT fromTerms(__DT __sum) const { return __sum; }
+    };
+    /// @brief 余弦距离策略，不满足三角不等式，不能用于VP树
+    struct Cosine {
+        template<class __DT, class __T>
+        inline __DT distance(const __T* __record, const __T* __sample, long long __dimension) const {
+            return cosine<__T, __DT>(__record, __sample, __dimension);
+        }
+    };
+    /// @brief 一致的权重策略
+    struct UniformWeight {
+        template<class __DT, class __T>
+        inline __DT weight(__DT __distance, const __T*, long long) const {
+            return __distance;
+        }
+    };
+
+    /// @brief 以`std::function`包装任意距离函数的策略（类型擦除适配器）
+    /// 也接受旧版签名`__DT(const std::vector<__T>*, const std::vector<__T>*)`的函数，此时每次调用复制两行，仅用于兼容
+    /// @tparam __T 数据类型
+    /// @tparam __DT 距离类型
+    template<class __T, class __DT>
+    struct FunctionalDistance {
+        typedef std::function<__DT(const __T*, const __T*, long long)> func_type;
+        FunctionalDistance() : func(euclidean<__T, __DT>) {}
+        template<class __F, class = std::enable_if_t<!std::is_same_v<std::decay_t<__F>, FunctionalDistance>>>
+        FunctionalDistance(__F&& __func) : func(adapt(std::forward<__F>(__func))) {}
+
+        template<class __D = __DT>
+        inline __DT distance(const __T* __record, const __T* __sample, long long __dimension) const {
+            return func(__record, __sample, __dimension);
+        }
+        func_type func;
+
+        private:
+        template<class __F>
+        static func_type adapt(__F&& __func) {
+            if constexpr (!std::is_invocable_v<__F&, const __T*, const __T*, long long> &&
+                          std::is_invocable_v<__F&, const std::vector<__T>*, const std::vector<__T>*>) {
+                return [old = std::forward<__F>(__func)](const __T* __record, const __T* __sample, long long __dimension) {
+                    const std::vector<__T> record(__record, __record + __dimension), sample(__sample, __sample + __dimension);
+                    return static_cast<__DT>(old(&record, &sample));
+                };
+            } else {
+                return func_type(std::forward<__F>(__func));
+            }
+        }
+    };
+    /// @brief 以`std::function`包装任意权重函数的策略（类型擦除适配器）
+    /// 也接受旧版签名`__DT(__DT, const std::vector<__T>*)`的函数，此时每次调用复制一行，仅用于兼容
+    /// @tparam __T 数据类型
+    /// @tparam __DT 距离类型
+    template<class __T, class __DT>
+    struct FunctionalWeight {
+        typedef std::function<__DT(__DT, const __T*, long long)> func_type;
+        FunctionalWeight() : func(uniformWeight<__T, __DT>) {}
+        template<class __F, class = std::enable_if_t<!std::is_same_v<std::decay_t<__F>, FunctionalWeight>>>
+        FunctionalWeight(__F&& __func) : func(adapt(std::forward<__F>(__func))) {}
+
+        template<class __D = __DT>
+        inline __DT weight(__DT __distance, const __T* __record, long long __dimension) const {
+            return func(__distance, __record, __dimension);
+        }
+        func_type func;
+
+        private:
+        template<class __F>
+        static func_type adapt(__F&& __func) {
+            if constexpr (!std::is_invocable_v<__F&, __DT, const __T*, long long> &&
+                          std::is_invocable_v<__F&, __DT, const std::vector<__T>*>) {
+                return [old = std::forward<__F>(__func)](__DT __distance, const __T* __record, long long __dimension) {
+                    const std::vector<__T> record(__record, __record + __dimension);
+                    return static_cast<__DT>(old(__distance, &record));
+                };
+            } else {
+                return func_type(std::forward<__F>(__func));
+            }
+        }
+    };
+
+    /// @brief 距离策略是否可按坐标轴分解，即是否提供`term`与`fromTerms`
+    template<class __Distance, class __DT, class = void>
+    struct has_axis_terms : std::false_type {};
+    template<class __Distance, class __DT>
+    struct has_axis_terms<__Distance, __DT, std::void_t<
+        decltype(std::declval<const __Distance&>().template term<__DT>(__DT())),
+        decltype(std::declval<const __Distance&>().template fromTerms<__DT>(__DT()))>> : std::true_type {};
+
+    template<class __T, class __DT, class __ST>
+    class BaseKNN {
+        public:
+        typedef std::vector<RecordView<__T, __ST>> result_type;
+        virtual void get(const std::vector<__T>& __vec, int k,
+                        result_type& __container) = 0;
+        virtual void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
+                                    result_type& __container) = 0;
+        /// @brief 批量查询，默认逐个调用`get`，多线程时将查询分块提交至全局线程池
+        /// @param __queries 要查询的向量
+        /// @param k 参数k
+        /// @param __results 每个查询对应的结果，按`__queries`的顺序排列
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        virtual void getBatch(const std::vector<std::vector<__T>>& __queries, int k,
+                              std::vector<result_type>& __results, int thread_cnt = -1) {
+            __results.resize(__queries.size());
+            parallelChunks(__queries.size(), thread_cnt, [&](long long left, long long right) {
+                for (long long i = left; i < right; ++i) {
+                    get(__queries[i], k, __results[i]);
+                }
+            });
+        }
+        result_type getResultContainer() {
+            return result_type();
+        }
+        virtual const DataSet<__T, __ST>* getDatasetRef() const = 0;
+        virtual ~BaseKNN() = default;
+
+        protected:
+        /// @brief 将`[0, __tot)`切分为若干块交给`__func(left, right)`处理，
+        ///        `thread_cnt`为正时各块作为任务提交至全局线程池
+        template<class __F>
+        static void parallelChunks(long long __tot, int thread_cnt, __F&& __func) {
+            if (thread_cnt <= 1 || __tot <= 1) {
+                __func(0LL, __tot);
+                return;
+            }
+            ThreadPool& pool = ThreadPool::global();
+            // 块数多于线程数，使窃取能够平衡各块耗时的差异
+            long long chunk_cnt = std::min<long long>(__tot, 4LL * thread_cnt);
+            long long unit = (__tot + chunk_cnt - 1) / chunk_cnt;
+            std::vector<std::future<void>> rets;
+            rets.reserve(chunk_cnt);
+            for (long long left = 0; left < __tot; left += unit) {
+                long long right = std::min(__tot, left + unit);
+                rets.push_back(pool.submit([&__func, left, right]() { __func(left, right); }));
+            }
+            for (auto& ret : rets) pool.wait(ret);
+        }
+    };
+
+    /// @brief 容量固定的前k近候选缓冲区
+    ///        k不超过`sorted_limit`时以插入排序维护有序数组，否则维护以距离为键的4叉最大堆；
+    ///        存储在`reset`间复用，预热后查询过程中不再分配内存
+    /// @tparam __DT 距离类型
+    template<class __DT>
+    class TopK {
+        public:
+        typedef std::pair<long long, __DT> value_type;
+        /// @brief 使用有序数组的最大k值，更大的k改用堆
+        static constexpr int sorted_limit = 32;
+
+        explicit TopK(int __k = 0) { reset(__k); }
+
+        /// @brief 清空并设置容量，已分配的存储被保留
+        void reset(int __k) {
+            k = std::max(__k, 0);
+            items.clear();
+            if (items.capacity() < static_cast<std::size_t>(k)) items.reserve(k);
+            worst = k ? std::numeric_limits<__DT>::max() : std::numeric_limits<__DT>::lowest();
+        }
+        /// @brief 当前第k近的距离，未满时为类型最大值；距离不小于该值的候选在已满时必被拒绝
+        inline __DT threshold() const { return worst; }
+        inline bool full() const { return items.size() >= static_cast<std::size_t>(k); }
+        inline std::size_t size() const { return items.size(); }
+        inline int capacity() const { return k; }
+
+        /// @brief 加入候选，仅在未满或比当前第k近更近时保留
+        inline void push(long long __index, __DT __distance) {
+            // 未满时`worst`为类型最大值，常见的拒绝只需一次比较
+            if (__distance < worst || !full()) insert(__index, __distance);
+        }
+        /// @brief 按距离升序排列并返回首元素指针，之后须`reset`才能继续加入
+        const value_type* sorted() {
+            if (k > sorted_limit) {
+                std::sort(items.begin(), items.end(), [](const value_type& a, const value_type& b) {
+                    return a.second < b.second || (!(b.second < a.second) && a.first < b.first);
+                });
+            }
+            return items.data();
+        }
+        /// @brief 按距离升序写入结果容器并清空
+        template<class __T, class __ST>
+        void collect(const DataSet<__T, __ST>* __dataset, std::vector<RecordView<__T, __ST>>& __container) {
+            const value_type* ret = sorted();
+            __container.resize(items.size());
+            for (std::size_t i = 0; i < items.size(); ++i) __container[i] = __dataset->getRef(ret[i].first);
+            reset(k);
+        }
+
+        private:
+        void insert(long long __index, __DT __distance) {
+            if (full()) {
+                if (k <= sorted_limit) insertSorted(k - 1, __index, __distance);
+                else replaceTop(__index, __distance);
+            } else {
+                items.emplace_back(__index, __distance);
+                if (k <= sorted_limit) insertSorted(items.size() - 1, __index, __distance);
+                else siftUp(items.size() - 1);
+            }
+            if (full()) worst = k <= sorted_limit ? items.back().second : items.front().second;
+        }
+        /// @brief 将位置`__pos`处的空位前移至有序位置后放入候选，距离相同时先到者在前
+        inline void insertSorted(std::size_t __pos, long long __index, __DT __distance) {
+            while (__pos > 0 && __distance < items[__pos - 1].second) {
+                items[__pos] = items[__pos - 1];
+                --__pos;
+            }
+            items[__pos] = value_type(__index, __distance);
+        }
+        inline void siftUp(std::size_t __pos) {
+            value_type v = items[__pos];
+            while (__pos > 0) {
+                std::size_t parent = (__pos - 1) >> 2;
+                if (!(items[parent].second < v.second)) break;
+                items[__pos] = items[parent];
+                __pos = parent;
+            }
+            items[__pos] = v;
+        }
+        inline void replaceTop(long long __index, __DT __distance) {
+            const std::size_t n = items.size();
+            std::size_t pos = 0;
+            while (true) {
+                std::size_t child = (pos << 2) + 1;
+                if (child >= n) break;
+                std::size_t last = std::min(child + 4, n), best = child;
+                for (std::size_t c = child + 1; c < last; ++c) {
+                    if (items[best].second < items[c].second) best = c;
+                }
+                if (!(__distance < items[best].second)) break;
+                items[pos] = items[best];
+                pos = best;
+            }
+            items[pos] = value_type(__index, __distance);
+        }
+
+        std::vector<value_type> items;
+        __DT worst;
+        int k;
+    };
+
+    /// @brief 树形索引查询时保存当前k个最近候选的缓冲区
+    /// 多线程查询时各任务的缓冲区可共享一个原子的第k近距离上界，任一缓冲区填满后即以其第k近距离收紧该上界
+    /// @tparam __DT 距离类型
+    template<class __DT>
+    class CandidateHeap {
+        public:
+        typedef std::pair<long long, __DT> value_type;
+        /// @param __k 保留的候选数量
+        /// @param __shared 共享的上界，单线程查询时为`nullptr`
+        explicit CandidateHeap(int __k = 0, std::atomic<__DT>* __shared = nullptr)
+            : items(__k), shared(__shared) {}
+
+        /// @brief 当前线程复用的单线程查询缓冲区，重置为容量`__k`；
+        ///        持有期间不能等待线程池任务，否则同一线程上运行的其它查询会覆盖其内容
+        static CandidateHeap& local(int __k) {
+            static thread_local CandidateHeap ret;
+            ret.items.reset(__k);
+            ret.shared = nullptr;
+            return ret;
+        }
+
+        /// @brief 加入候选，仅在未满或比当前第k近更近时保留
+        inline void push(long long __index, __DT __distance) {
+            if (items.full() && !(__distance < items.threshold())) return;
+            items.push(__index, __distance);
+            if (shared != nullptr && items.full()) {
+                __DT top = items.threshold();
+                __DT cur = shared->load(std::memory_order_relaxed);
+                while (top < cur && !shared->compare_exchange_weak(cur, top, std::memory_order_relaxed)) {}
+            }
+        }
+        /// @brief 剪枝所用的上界，未满且无共享上界时为类型最大值
+        inline __DT bound() const {
+            __DT ret = items.threshold();
+            if (shared != nullptr) ret = std::min(ret, shared->load(std::memory_order_relaxed));
+            return ret;
+        }
+        inline bool full() const { return items.full(); }
+        inline std::size_t size() const { return items.size(); }
+        inline int capacity() const { return items.capacity(); }
+
+        /// @brief 并入另一个缓冲区中的全部候选，`__other`被清空
+        void merge(CandidateHeap& __other) {
+            const value_type* ret = __other.items.sorted();
+            for (std::size_t i = 0; i < __other.items.size(); ++i) push(ret[i].first, ret[i].second);
+            __other.items.reset(__other.items.capacity());
+        }
+        /// @brief 按距离升序取出全部候选，缓冲区被清空
+        template<class __T, class __ST>
+        void collect(const DataSet<__T, __ST>* __dataset, std::vector<RecordView<__T, __ST>>& __container) {
+            items.collect(__dataset, __container);
+        }
+        /// @brief 按距离升序取出全部候选及其距离，缓冲区被清空
+        std::vector<value_type> take() {
+            const value_type* ret = items.sorted();
+            std::vector<value_type> out(ret, ret + items.size());
+            items.reset(items.capacity());
+            return out;
+        }
+
+        private:
+        TopK<__DT> items;
+        std::atomic<__DT>* shared;
+    };
+
     /// @brief 暴力法KNN
     /// @tparam __T 数据集中的数据类型 `Type`
     /// @tparam __DT 距离计算过程中的数据类型 `Distance Type`
     /// @tparam __ST 数据分类的数据类型 `State Type`
-    template<class __T = double, class __DT = __T, class __ST = int>
+    /// @tparam __Distance 距离策略，如`Euclidean`, `Manhattan`, `FunctionalDistance<__T, __DT>`
+    /// @tparam __Weight 权重策略，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = Euclidean, class __Weight = UniformWeight>
     class Brute : public BaseKNN<__T, __DT, __ST> {
         public:
-        /// @brief 以指定数据集，权重函数和距离函数初始化
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
+        /// @brief 以指定数据集，权重策略和距离策略初始化
         /// @param __dataset 数据集
-        /// @param __weight_func 权重函数，类型为`__DT(__DT, const std::vector<__T>*)`
-        /// @param __distance_func 距离函数，类型为`__DT(const std::vector<__T>*, const std::vector<__T>*)`
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象，使用`FunctionalDistance`时可直接传入函数
         Brute(const DataSet<__T, __ST>& __dataset, 
-            std::function<__DT(__DT, const std::vector<__T>*)> __weight_func = uniformWeight<__T, __DT>,
-            std::function<__DT(const std::vector<__T>*, const std::vector<__T>*)> __distance_func = euclidean<__T, __DT>) {
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
             data_ptr = &__dataset;
+            dimension = data_ptr->getDimension();
             weight_func = __weight_func;
             distance_func = __distance_func;
         }
         /// @brief 获取结果
         /// @param __vec 预测的向量
         /// @param k 参数k
-        /// @param __container 储存结果的容器，类型为`std::vector<const Record<__T, __ST>*>`
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
         void get(const std::vector<__T>& __vec, int k,
-                std::vector<const Record<__T, __ST>*>& __container) override {
-            typedef std::pair<const Record<__T, __ST>*, __DT> data_pair;
-            auto cmp = [](const data_pair& left, const data_pair& right){
-                if (left.second < right.second) return true;
-                return false;
-            };
-            std::priority_queue<data_pair, std::vector<data_pair>, decltype(cmp)> kq(cmp);
-            
-            const Record<__T, __ST>* __rec_ptr;
-            for (long long i = 0; i < data_ptr->dataSize(); ++i) {
-                __rec_ptr = data_ptr->getRef(i);
-                __DT val = weight_func(distance_func(&(__rec_ptr->vec), &__vec),
-                                    &(__rec_ptr->vec));
-                if (kq.size() < k) {
-                    kq.push(std::make_pair(__rec_ptr, val));
-                } else {
-                    if (val < kq.top().second) {
-                        kq.pop();
-                        kq.push(std::make_pair(__rec_ptr, val));
-                    }
-                }
-            }
-            int size = kq.size();
-            __container.resize(size);
-            while (size > 0) {
-                __container[size - 1] = kq.top().first;
-                kq.pop(); --size;
-            }
+                result_type& __container) override {
+            sub_ret& kq = scratch(k);
+            scanRange(0, data_ptr->dataSize() - 1, __vec.data(), kq);
+            kq.collect(data_ptr, __container);
         }
 
         /// @brief 多线程查询
         /// @param __vec 要查询的向量
         /// @param k 参数k
         /// @param thread_cnt 使用的线程数
-        /// @param __container 保存结果的容器，类型为`std::vector<const Record<__T, __ST>*>`
+        /// @param __container 保存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
         void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
-                            std::vector<const Record<__T, __ST>*>& __container) override {
-            std::vector<std::thread*> thread_pool;
-            std::vector<std::future<sub_ret*>> sub_task_rets;
-            thread_pool.reserve(thread_cnt);
+                            result_type& __container) override {
+            if (thread_cnt <= 1) {
+                this->get(__vec, k, __container);
+                return;
+            }
+            ThreadPool& pool = ThreadPool::global();
+            std::vector<std::future<void>> sub_task_rets;
             sub_task_rets.reserve(thread_cnt);
-            long long unit_len = data_ptr->dataSize() / thread_cnt;
-            long long left = 0, right = 0;
+            // 各任务在所在线程的缓冲区中扫描，排好序的候选写入`partial`中属于自己的k个位置
+            const std::size_t slot = std::max(k, 0);
+            std::vector<sub_pair> partial(thread_cnt * slot);
+            std::vector<std::size_t> partial_size(thread_cnt, 0);
+            const long long tot = data_ptr->dataSize();
 
             for (int i = 0; i < thread_cnt; ++i) {
-                if (i == thread_cnt - 1) {
-                    right = data_ptr->dataSize() - 1;
-                } else {
-                    right = left + unit_len - 1;
-                }
-                std::promise<sub_ret*> __promise;
-                sub_task_rets.push_back(__promise.get_future());
-                auto ptr = new std::thread(&subTask, this, left, right, 
-                                           __vec, std::move(__promise), k);
-                thread_pool.push_back(ptr);
-                left = right + 1;
+                // 各段长度至多相差1
+                const long long left = i * tot / thread_cnt;
+                const long long right = (i + 1) * tot / thread_cnt - 1;
+                sub_task_rets.push_back(pool.submit([this, left, right, &__vec, k, i, slot, &partial, &partial_size]() {
+                    sub_ret& kq = scratch(k);
+                    scanRange(left, right, __vec.data(), kq);
+                    const sub_pair* ret = kq.sorted();
+                    std::copy(ret, ret + kq.size(), partial.begin() + i * slot);
+                    partial_size[i] = kq.size();
+                    kq.reset(k);
+                }));
             }
 
-            sub_ret results;
+            for (auto& ret : sub_task_rets) pool.wait(ret);
+            sub_ret& results = scratch(k);
             for (int i = 0; i < thread_cnt; ++i) {
-                thread_pool.at(i)->join();
-                sub_ret* ret_ptr = sub_task_rets[i].get();
-                sub_pair __sub_pair;
-                while (ret_ptr->size()) {
-                    __sub_pair = ret_ptr->top();
-                    if (results.size() < k) {
-                        results.push(__sub_pair);
-                    } else if (results.top().second > __sub_pair.second) {
-                        results.pop();
-                        results.push(__sub_pair);
+                const sub_pair* ret = partial.data() + i * slot;
+                for (std::size_t j = 0; j < partial_size[i]; ++j) results.push(ret[j].first, ret[j].second);
+            }
+            results.collect(data_ptr, __container);
+        }
+
+        /// @brief 批量查询，使用欧氏距离与一致权重时按分块矩阵方式计算
+        /// @param __queries 要查询的向量
+        /// @param k 参数k
+        /// @param __results 每个查询对应的结果
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        void getBatch(const std::vector<std::vector<__T>>& __queries, int k,
+                      std::vector<result_type>& __results, int thread_cnt = -1) override {
+            constexpr bool expandable = (std::is_same_v<__Distance, Euclidean> ||
+                                         std::is_same_v<__Distance, SquaredEuclidean>) &&
+                                        std::is_same_v<__Weight, UniformWeight>;
+            if constexpr (!expandable) {
+                BaseKNN<__T, __DT, __ST>::getBatch(__queries, k, __results, thread_cnt);
+            } else {
+                const long long tot = data_ptr->dataSize();
+                const __T* rows = data_ptr->featureData();
+                // 特征不连续存放时(如`DataSetView`)先复制为连续的一块，各查询块共用
+                std::vector<__T, AlignedAllocator<__T>> gathered;
+                if (rows == nullptr) {
+                    gathered.resize(tot * dimension);
+                    for (long long i = 0; i < tot; ++i) {
+                        const __T* x = data_ptr->getRef(i).vec;
+                        std::copy(x, x + dimension, gathered.begin() + i * dimension);
+                    }
+                    rows = gathered.data();
+                }
+                std::vector<__DT> row_norms(tot);
+                for (long long i = 0; i < tot; ++i) {
+                    row_norms[i] = dot(rows + i * dimension, rows + i * dimension);
+                }
+                __results.resize(__queries.size());
+                this->parallelChunks(__queries.size(), thread_cnt, [&](long long left, long long right) {
+                    blockedBatch(rows, __queries, left, right, row_norms, k, __results);
+                });
+            }
+        }
+
+        const DataSet<__T, __ST>* getDatasetRef() const override {
+            return data_ptr;
+        }
+
+        private:
+
+        /// @brief 以 ||q||² + ||x||² - 2q·x 分块计算平方欧氏距离，
+        ///        每个训练块转置打包后在一组查询间复用
+        /// @param rows 按行连续存放的训练数据
+        void blockedBatch(const __T* rows, const std::vector<std::vector<__T>>& __queries, long long __q_left,
+                          long long __q_right, const std::vector<__DT>& row_norms, int k,
+                          std::vector<result_type>& __results) {
+            constexpr long long row_block = 256;
+            constexpr long long query_block = 64;
+            const long long tot = data_ptr->dataSize();
+            const long long q_tot = __q_right;
+
+            // packed[j * row_block + r] 为块内第r行的第j维
+            std::vector<__DT> packed(dimension * row_block);
+            std::vector<__DT> block_dist(row_block);
+            std::vector<__DT> query_buf(query_block * dimension);
+            std::vector<sub_ret> heaps(query_block);
+            std::vector<__DT> query_norms(query_block);
+
+            for (long long q_begin = __q_left; q_begin < q_tot; q_begin += query_block) {
+                const long long q_cnt = std::min(query_block, q_tot - q_begin);
+                for (long long qi = 0; qi < q_cnt; ++qi) {
+                    const __T* q = __queries[q_begin + qi].data();
+                    query_norms[qi] = dot(q, q);
+                    for (long long j = 0; j < dimension; ++j) {
+                        query_buf[qi * dimension + j] = static_cast<__DT>(q[j]);
+                    }
+                    heaps[qi].reset(k);
+                }
+                for (long long r_begin = 0; r_begin < tot; r_begin += row_block) {
+                    const long long r_cnt = std::min(row_block, tot - r_begin);
+                    for (long long r = 0; r < r_cnt; ++r) {
+                        const __T* x = rows + (r_begin + r) * dimension;
+                        for (long long j = 0; j < dimension; ++j) {
+                            packed[j * row_block + r] = static_cast<__DT>(x[j]);
+                        }
+                    }
+                    if (r_cnt < row_block) {
+                        for (long long j = 0; j < dimension; ++j) {
+                            std::fill(packed.begin() + j * row_block + r_cnt,
+                                      packed.begin() + (j + 1) * row_block, __DT{0});
+                        }
+                    }
+                    for (long long qi = 0; qi < q_cnt; ++qi) {
+                        const __DT* q = query_buf.data() + qi * dimension;
+                        __DT* dist = block_dist.data();
+                        if constexpr (simd::has_kernel<__DT>) {
+                            simd::packedDot(packed.data(), row_block, dimension, q, dist);
+                        } else {
+                            simd::packedDotScalar(packed.data(), row_block, dimension, q, dist);
+                        }
+                        sub_ret& kq = heaps[qi];
+                        const __DT qn = query_norms[qi];
+                        const __DT* xn = row_norms.data() + r_begin;
+                        __DT bound = kq.threshold();
+                        for (long long r = 0; r < r_cnt; ++r) {
+                            dist[r] = std::max(__DT{0}, qn + xn[r] - 2 * dist[r]);
+                        }
+                        // 先整块求出距离再逐个与第k近距离比较，块内多数行在这一步即被排除
+                        for (long long r = 0; r < r_cnt; ++r) {
+                            if (dist[r] < bound || !kq.full()) {
+                                kq.push(r_begin + r, dist[r]);
+                                bound = kq.threshold();
+                            }
+                        }
                     }
-                    ret_ptr->pop();
                 }
+                for (long long qi = 0; qi < q_cnt; ++qi) {
+                    result_type& container = __results[q_begin + qi];
+                    heaps[qi].collect(data_ptr, container);
+                }
+            }
+        }
+
+        inline __DT dot(const __T* __a, const __T* __b) const {
+            __DT sum{0};
+            for (long long j = 0; j < dimension; ++j) {
+                sum += static_cast<__DT>(__a[j]) * static_cast<__DT>(__b[j]);
+            }
+            return sum;
+        }
 
-                delete thread_pool.at(i);
-                delete ret_ptr;
-                thread_pool.at(i) = nullptr;
+        typedef TopK<__DT> sub_ret;
+        typedef typename sub_ret::value_type sub_pair;
+
+        /// @brief 当前线程复用的候选缓冲区，重置为容量`k`；持有期间不能等待线程池任务
+        static inline sub_ret& scratch(int k) {
+            static thread_local sub_ret ret;
+            ret.reset(k);
+            return ret;
+        }
+
+        /// @brief 扫描编号在`[left, right]`内的记录，结果合并入`__kq`
+        void scanRange(long long left, long long right, const __T* __vec, sub_ret& __kq) {
+            const __T* rows = data_ptr->featureData();
+            const __T* __row;
+            __DT bound = __kq.threshold();
+            for (long long index = left; index <= right; ++index) {
+                __row = rows ? rows + index * dimension : data_ptr->getRef(index).vec;
+                __DT distance = evaluate(__row, __vec);
+                if (distance < bound || !__kq.full()) {
+                    __kq.push(index, distance);
+                    bound = __kq.threshold();
+                }
             }
+        }
+
+        inline __DT evaluate(const __T* __row, const __T* __vec) const {
+            return weight_func.template weight<__DT>(
+                distance_func.template distance<__DT>(__row, __vec, dimension), __row, dimension);
+        }
+        
+        long long dimension;
+        const DataSet<__T, __ST>* data_ptr;
+        __Weight weight_func;
+        __Distance distance_func;
+    };
+
+    /// @brief 向量排序使用的比较
+    template<class __T, class __ST>
+    class KDSort {
+        public:
+        KDSort(const DataSet<__T, __ST>* __dataset, long long __dimension) {
+            data_ptr = __dataset;
+            dim = __dimension;
+            rows = data_ptr->featureData();
+            stride = data_ptr->getDimension();
+        }
+        /// @brief 比较连续存放于`__rows`中的向量，下标为行号
+        KDSort(const __T* __rows, long long __stride, long long __dimension) {
+            data_ptr = nullptr;
+            dim = __dimension;
+            rows = __rows;
+            stride = __stride;
+        }
+        bool operator() (long long left, long long right) {
+            if (at(left) < at(right)) return true;
+            return false;
+        }
+        private:
+        inline __T at(long long __index) const {
+            return (rows != nullptr) ? rows[__index * stride + dim] : data_ptr->getRef(__index).vec[dim];
+        }
+        const DataSet<__T, __ST>* data_ptr;
+        const __T* rows;
+        long long dim, stride;
+    };
+
+    /// @brief K-Dimension Tree法KNN
+    /// 树以隐式数组存储：内部结点按广度优先顺序编号，结点i的子结点为2i+1与2i+2，
+    /// 叶结点为至多`leaf_size`个点组成的桶，桶内的向量按叶结点顺序连续存放于树内部。
+    /// 仅当权重为`UniformWeight`且距离策略可按坐标轴分解时剪枝，否则遍历所有叶结点以保证结果精确
+    /// @tparam __T 数据集中的数据类型 `Type`
+    /// @tparam __DT 距离计算过程中的数据类型 `Distance Type`
+    /// @tparam __ST 数据分类的数据类型 `State Type`
+    /// @tparam __Distance 距离策略，如`Euclidean`, `Manhattan`, `FunctionalDistance<__T, __DT>`
+    /// @tparam __Weight 权重策略，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = Euclidean, class __Weight = UniformWeight>
+    class KDTree : public BaseKNN<__T, __DT, __ST>{
+        public:
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
+        /// @brief 叶结点桶的最大容量
+        static constexpr long long leaf_size = 32;
 
-            int size = results.size();
-            __container.resize(size);
-            while (size > 0) {
-                __container[size - 1] = results.top().first;
-                results.pop(); --size;
+        /// @brief 以指定数据集，权重策略和距离策略初始化
+        /// @param __dataset 数据集
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象，使用`FunctionalDistance`时可直接传入函数
+        KDTree(const DataSet<__T, __ST>& __dataset, 
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, __weight_func, __distance_func);
+            tot_samples = data_ptr->dataSize();
+            ids.resize(tot_samples);
+            for (long long i = 0; i < tot_samples; ++i) {
+                ids[i] = i;
+            }
+            // 特征不连续存放时(如`DataSetView`)先复制为连续的一块，构建时不再逐个经由`getRef`读取
+            const __T* rows = data_ptr->featureData();
+            std::vector<__T, AlignedAllocator<__T>> gathered;
+            if (rows == nullptr && tot_samples > 0) {
+                gather(ids, gathered);
+                rows = gathered.data();
+            }
+            build(rows);
+        }
+        /// @brief 仅以数据集中的部分记录构建，结果中的下标仍为记录在数据集中的下标
+        /// @param __dataset 数据集
+        /// @param __subset 参与构建的记录下标
+        /// @param __rows 按`__subset`顺序连续存放的对应向量，为`nullptr`时从数据集中复制。
+        ///        提供该参数时构建过程不访问数据集
+        KDTree(const DataSet<__T, __ST>& __dataset, const std::vector<long long>& __subset,
+            const __T* __rows = nullptr,
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, __weight_func, __distance_func);
+            tot_samples = static_cast<long long>(__subset.size());
+            std::vector<__T, AlignedAllocator<__T>> gathered;
+            if (__rows == nullptr && tot_samples > 0) {
+                gather(__subset, gathered);
+                __rows = gathered.data();
             }
+            ids.resize(tot_samples);
+            for (long long i = 0; i < tot_samples; ++i) {
+                ids[i] = i;
+            }
+            build(__rows);
+            for (auto& id : ids) id = __subset[id];
         }
 
         const DataSet<__T, __ST>* getDatasetRef() const override {
             return data_ptr;
         }
+        
+        /// @brief 获取结果，不保证返回数量为k
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void get(const std::vector<__T>& __vec, int k, 
+                result_type& __container) override {
+            __container.clear();
+            if (leaf_cnt == 0 || k <= 0) return;
 
-        private:
+            CandidateHeap<__DT>& tpk = CandidateHeap<__DT>::local(k);
+            search(__vec, tpk);
+            tpk.collect(data_ptr, __container);
+        }
+        
+        /// @brief 多线程获取结果
+        ///        将树展开至不少于若干倍线程数的子树，各子树作为任务提交至全局线程池，
+        ///        任务间共享当前第k近距离的上界用于剪枝
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
+                            result_type& __container) override {
+            if (thread_cnt <= 1) {
+                this->get(__vec, k, __container);
+                return;
+            }
+            __container.clear();
+            if (leaf_cnt == 0 || k <= 0) return;
 
-        typedef std::pair<const Record<__T, __ST>*, __DT> sub_pair;
-        struct __Compare {
-            bool operator()(const sub_pair& left, const sub_pair& right) {
-                if (left.second < right.second) return true;
-                return false;
+            CandidateHeap<__DT> tpk(k);
+            search(__vec, tpk, thread_cnt);
+            tpk.collect(data_ptr, __container);
+        }
+
+        /// @brief 将树中的候选并入已有的堆，供由多棵树组合而成的索引使用
+        /// @param __vec 预测的向量
+        /// @param __tpk 候选堆，其中已有的候选参与剪枝
+        /// @param thread_cnt 线程数，若不大于1，则不使用多线程
+        /// @param __erased 以数据集下标索引的删除标记，标记非零的点被跳过，为`nullptr`时不跳过任何点
+        void search(const std::vector<__T>& __vec, CandidateHeap<__DT>& __tpk, int thread_cnt = -1,
+                    const unsigned char* __erased = nullptr) const {
+            if (leaf_cnt == 0 || __tpk.capacity() <= 0) return;
+            if (thread_cnt <= 1) {
+                std::vector<__DT> offset(dimension, __DT{0});
+                searchTree(0, __DT{0}, offset, __vec, __tpk, __erased);
+                return;
             }
-        };
-        typedef std::priority_queue<sub_pair, std::vector<sub_pair>, __Compare> sub_ret;
 
-        void subTask(long long left, long long right, std::vector<__T> __vec,
-                     std::promise<sub_ret*> __promise, int k) {
-            sub_ret* ptr = new sub_ret();
-            const Record<__T, __ST>* __rec_ptr;
-            for (long long index = left; index <= right; ++index) {
-                __rec_ptr = data_ptr->getRef(index);
-                __DT distance = weight_func(distance_func(&(__rec_ptr->vec), &__vec),
-                                            &(__rec_ptr->vec));
-                if (ptr->size() < k) {
-                    ptr->push(std::make_pair(__rec_ptr, distance));
-                } else if (distance < ptr->top().second) {
-                    ptr->pop();
-                    ptr->push(std::make_pair(__rec_ptr, distance));
+            std::vector<Frontier> frontier{Frontier{0, __DT{0}, std::vector<__DT>(dimension, __DT{0})}};
+            const std::size_t target = 4 * static_cast<std::size_t>(thread_cnt);
+            while (frontier.size() < target && frontier.front().node < leaf_cnt - 1) {
+                std::vector<Frontier> next;
+                next.reserve(frontier.size() * 2);
+                for (Frontier& f : frontier) {
+                    long long dim = split_dim[f.node];
+                    __DT axis_diff = static_cast<__DT>(__vec[dim]) - static_cast<__DT>(split_val[f.node]);
+                    bool left_flg = (axis_diff < 0);
+                    Frontier far{2 * f.node + (left_flg ? 2 : 1), farTerms(f.rd, f.offset[dim], axis_diff), f.offset};
+                    far.offset[dim] = axis_diff;
+                    next.push_back(Frontier{2 * f.node + (left_flg ? 1 : 2), f.rd, std::move(f.offset)});
+                    next.push_back(std::move(far));
                 }
+                frontier.swap(next);
+            }
+            std::sort(frontier.begin(), frontier.end(),
+                      [](const Frontier& a, const Frontier& b) { return a.rd < b.rd; });
+
+            const int k = __tpk.capacity();
+            std::atomic<__DT> shared_bound(__tpk.bound());
+            ThreadPool& pool = ThreadPool::global();
+            std::vector<std::future<CandidateHeap<__DT>>> rets;
+            rets.reserve(frontier.size());
+            for (const Frontier& f : frontier) {
+                rets.push_back(pool.submit([this, &f, &__vec, k, &shared_bound, __erased]() {
+                    CandidateHeap<__DT> local(k, &shared_bound);
+                    std::vector<__DT> offset = f.offset;
+                    searchTree(f.node, f.rd, offset, __vec, local, __erased);
+                    return local;
+                }));
+            }
+            for (auto& ret : rets) {
+                CandidateHeap<__DT> local = pool.wait(ret);
+                __tpk.merge(local);
             }
-            __promise.set_value(ptr);
         }
-        
+
+        /// @brief 树中的点数
+        inline long long indexedSize() const { return tot_samples; }
+        /// @brief 树中的点在数据集中的下标，按叶结点顺序排列
+        inline const std::vector<long long>& indexedIds() const { return ids; }
+
+        private:
+        /// @brief 是否可依据超矩形距离下界剪枝
+        static constexpr bool prunable = std::is_same_v<__Weight, UniformWeight> &&
+                                         has_axis_terms<__Distance, __DT>::value;
+
+        /// @brief 多线程查询时待搜索的子树
+        struct Frontier {
+            long long node;
+            /// @brief 查询点到子树超矩形的各轴`term`之和
+            __DT rd;
+            /// @brief 查询点到超矩形在各轴上的差值
+            std::vector<__DT> offset;
+        };
+
+        /// @brief 进入远侧子结点后超矩形距离的各轴`term`之和，仅替换划分轴上的一项
+        inline __DT farTerms(__DT __rd, __DT __old_offset, __DT __new_offset) const {
+            if constexpr (prunable) {
+                return __rd - distance_func.template term<__DT>(__old_offset)
+                            + distance_func.template term<__DT>(__new_offset);
+            } else {
+                return __rd;
+            }
+        }
+        /// @brief 超矩形距离下界为`__rd`的子树是否可能包含更近的点
+        inline bool reachable(__DT __rd, const CandidateHeap<__DT>& __tpk) const {
+            if constexpr (prunable) {
+                return distance_func.template fromTerms<__DT>(__rd) < __tpk.bound();
+            } else {
+                return true;
+            }
+        }
+
+        /// @brief 低于该规模的子树不再拆分为并行任务
+        static constexpr long long parallel_cutoff = 4096;
+
+        void init(const DataSet<__T, __ST>& __dataset, __Weight __weight_func, __Distance __distance_func) {
+            data_ptr = &__dataset;
+            dimension = data_ptr->getDimension();
+            leaf_cnt = 0;
+            weight_func = __weight_func;
+            distance_func = __distance_func;
+        }
+        /// @brief 以`ids`中的`tot_samples`个点构建树
+        /// @param __rows 以`ids`中的值为行号连续存放的向量，为`nullptr`时从数据集中读取
+        void build(const __T* __rows) {
+            if (tot_samples <= 0) return;
+
+            leaf_cnt = 1;
+            while (leaf_cnt * leaf_size < tot_samples) leaf_cnt <<= 1;
+            split_dim.assign(leaf_cnt - 1, 0);
+            split_val.assign(leaf_cnt - 1, __T());
+            leaf_offset.assign(leaf_cnt + 1, 0);
+            leaf_offset[leaf_cnt] = tot_samples;
+            int parallel_depth = 0;
+            ThreadPool& pool = ThreadPool::global();
+            if (pool.size() > 1 && tot_samples >= 2 * parallel_cutoff) {
+                while ((1 << parallel_depth) < 4 * pool.size()) ++parallel_depth;
+            }
+            construct(__rows, 0, 0, tot_samples, 0, parallel_depth);
+
+            points.resize(tot_samples * dimension);
+            for (long long i = 0; i < tot_samples; ++i) {
+                const __T* __row = rowAt(__rows, ids[i]);
+                std::copy(__row, __row + dimension, points.begin() + i * dimension);
+            }
+        }
+        /// @brief 将`__subset`中的记录按顺序复制为连续的一块
+        void gather(const std::vector<long long>& __subset, std::vector<__T, AlignedAllocator<__T>>& __out) const {
+            __out.resize(__subset.size() * dimension);
+            for (std::size_t i = 0; i < __subset.size(); ++i) {
+                const __T* __row = data_ptr->getRef(__subset[i]).vec;
+                std::copy(__row, __row + dimension, __out.begin() + i * dimension);
+            }
+        }
+        inline const __T* rowAt(const __T* __rows, long long __id) const {
+            return (__rows != nullptr) ? __rows + __id * dimension : data_ptr->getRef(__id).vec;
+        }
+
+        /// @brief 以中位数划分构建编号为`__node`的子树，覆盖`ids[left, right)`，划分维度取区间内跨度最大的维度
+        /// @param parallel_depth 小于该深度且规模足够时，左子树作为任务提交至全局线程池
+        void construct(const __T* __rows, long long __node, long long left, long long right,
+                       int depth, int parallel_depth) {
+            if (__node >= leaf_cnt - 1) {
+                long long leaf = __node - (leaf_cnt - 1);
+                leaf_offset[leaf] = left;
+                return;
+            }
+            long long mid = left + ((right - left) >> 1);
+            long long dim = (right - left > 1) ? widestDimension(__rows, left, right) : 0;
+            split_dim[__node] = dim;
+            if (right - left > 0) {
+                std::nth_element(ids.begin() + left, ids.begin() + mid, ids.begin() + right,
+                                 (__rows != nullptr) ? KDSort<__T, __ST>(__rows, dimension, dim)
+                                                     : KDSort<__T, __ST>(data_ptr, dim));
+            }
+            // 左子树中的点不大于划分值，右子树中的点不小于划分值
+            split_val[__node] = (mid < right) ? rowAt(__rows, ids[mid])[dim] : __T();
+            if (depth < parallel_depth && right - left >= parallel_cutoff) {
+                ThreadPool& pool = ThreadPool::global();
+                auto ret = pool.submit([this, __rows, __node, left, mid, depth, parallel_depth]() {
+                    construct(__rows, 2 * __node + 1, left, mid, depth + 1, parallel_depth);
+                });
+                construct(__rows, 2 * __node + 2, mid, right, depth + 1, parallel_depth);
+                pool.wait(ret);
+            } else {
+                construct(__rows, 2 * __node + 1, left, mid, depth + 1, parallel_depth);
+                construct(__rows, 2 * __node + 2, mid, right, depth + 1, parallel_depth);
+            }
+        }
+        /// @brief 区间内最大值与最小值之差最大的维度
+        long long widestDimension(const __T* __rows, long long left, long long right) const {
+            std::vector<__T> low(dimension), high(dimension);
+            const __T* first = rowAt(__rows, ids[left]);
+            std::copy(first, first + dimension, low.begin());
+            std::copy(first, first + dimension, high.begin());
+            for (long long i = left + 1; i < right; ++i) {
+                const __T* __row = rowAt(__rows, ids[i]);
+                for (long long j = 0; j < dimension; ++j) {
+                    if (__row[j] < low[j]) low[j] = __row[j];
+                    if (high[j] < __row[j]) high[j] = __row[j];
+                }
+            }
+            long long best = 0;
+            __DT best_spread = static_cast<__DT>(high[0]) - static_cast<__DT>(low[0]);
+            for (long long j = 1; j < dimension; ++j) {
+                __DT spread = static_cast<__DT>(high[j]) - static_cast<__DT>(low[j]);
+                if (best_spread < spread) {
+                    best_spread = spread;
+                    best = j;
+                }
+            }
+            return best;
+        }
+        /// @brief 逐个计算叶结点桶内的点
+        void scanLeaf(long long __leaf, const std::vector<__T>& __vec, CandidateHeap<__DT>& __tpk,
+                      const unsigned char* __erased) const {
+            for (long long i = leaf_offset[__leaf]; i < leaf_offset[__leaf + 1]; ++i) {
+                if (__erased != nullptr && __erased[ids[i]]) continue;
+                const __T* __row = points.data() + i * dimension;
+                __DT distance = weight_func.template weight<__DT>(
+                    distance_func.template distance<__DT>(__row, __vec.data(), dimension), __row, dimension);
+                __tpk.push(ids[i], distance);
+            }
+        }
+        /// @brief 以显式栈搜索子树，先近侧后远侧，超矩形距离下界不小于当前第k近距离的子树整体跳过
+        /// @param __node 子树根结点
+        /// @param __rd 查询点到子树超矩形的各轴`term`之和
+        /// @param __offset 查询点到超矩形在各轴上的差值，搜索过程中修改，返回时恢复
+        /// @param __erased 删除标记，见`search`
+        void searchTree(long long __node, __DT __rd, std::vector<__DT>& __offset, const std::vector<__T>& __vec,
+                    CandidateHeap<__DT>& __tpk, const unsigned char* __erased) const {
+            // stage 0: 进入结点；1: 近侧已完成，进入远侧；2: 远侧已完成，恢复划分轴上的差值
+            struct Frame {
+                long long node;
+                __DT rd, diff, saved;
+                int stage;
+            };
+            // 栈深不超过树高，叶结点数不超过2^62
+            std::array<Frame, 64> stack;
+            int top = 0;
+            stack[0] = Frame{__node, __rd, __DT{0}, __DT{0}, 0};
+            while (top >= 0) {
+                Frame& f = stack[top];
+                if (f.stage == 0) {
+                    if (!reachable(f.rd, __tpk)) {
+                        --top;
+                    } else if (f.node >= leaf_cnt - 1) {
+                        scanLeaf(f.node - (leaf_cnt - 1), __vec, __tpk, __erased);
+                        --top;
+                    } else {
+                        f.diff = static_cast<__DT>(__vec[split_dim[f.node]]) - static_cast<__DT>(split_val[f.node]);
+                        f.stage = 1;
+                        stack[++top] = Frame{2 * f.node + (f.diff < 0 ? 1 : 2), f.rd, __DT{0}, __DT{0}, 0};
+                    }
+                } else if (f.stage == 1) {
+                    long long dim = split_dim[f.node];
+                    f.saved = __offset[dim];
+                    f.stage = 2;
+                    __offset[dim] = f.diff;
+                    stack[++top] = Frame{2 * f.node + (f.diff < 0 ? 2 : 1),
+                                         farTerms(f.rd, f.saved, f.diff), __DT{0}, __DT{0}, 0};
+                } else {
+                    __offset[split_dim[f.node]] = f.saved;
+                    --top;
+                }
+            }
+        }
+
+        long long dimension, tot_samples;
+        /// @brief 叶结点数，为2的幂，内部结点数为`leaf_cnt - 1`
+        long long leaf_cnt;
+        std::vector<long long> split_dim;
+        std::vector<__T> split_val;
+        /// @brief 第i个叶结点的点位于`[leaf_offset[i], leaf_offset[i + 1])`
+        std::vector<long long> leaf_offset;
+        /// @brief 按叶结点顺序排列的点在原数据集中的下标
+        std::vector<long long> ids;
+        /// @brief 按叶结点顺序连续存放的向量
+        std::vector<__T, AlignedAllocator<__T>> points;
+        const DataSet<__T, __ST>* data_ptr;
+        __Weight weight_func;
+        __Distance distance_func;
+    };
+
+    /// @brief 动态KD树的参数
+    struct DynamicKDTreeParam {
+        /// @brief 插入缓冲区的容量，缓冲区中的点以线性扫描查询
+        long long buffer_size = 256;
+        /// @brief 某一层中被删除的点所占比例超过该值时重建该层
+        double rebuild_ratio = 0.5;
+        /// @brief 是否在后台线程上合并与重建，为`false`时在触发重建的`insert`或`erase`中完成
+        bool background = false;
+    };
+
+    /// @brief 支持插入与删除的K-Dimension Tree法KNN
+    /// 采用对数方法：新插入的点先进入容量为`buffer_size`的缓冲区，缓冲区填满后与第0至j-1层合并，重建为第j层的静态`KDTree`，
+    /// 其中j为最小的空层，因此第i层的规模约为`buffer_size * 2^i`，每次插入的均摊重建代价为O(log^2 n)。
+    /// 删除只写入标记，查询时跳过被标记的点；某一层中被删除的点过多时仅重建该层，合并时丢弃被删除的点。
+    /// 查询时以同一个候选堆依次搜索缓冲区与各层，已找到的候选参与后续各层的剪枝。
+    /// 插入的记录追加至数据集末尾，删除不修改数据集，结果中的下标即数据集中的下标。
+    /// 查询之间可以并发，插入与删除与查询互斥；后台重建期间查询使用旧的各层，新树构建完成后整体替换
+    /// @tparam __T 数据集中的数据类型 `Type`
+    /// @tparam __DT 距离计算过程中的数据类型 `Distance Type`
+    /// @tparam __ST 数据分类的数据类型 `State Type`
+    /// @tparam __Distance 距离策略，如`Euclidean`, `Manhattan`, `FunctionalDistance<__T, __DT>`
+    /// @tparam __Weight 权重策略，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = Euclidean, class __Weight = UniformWeight>
+    class DynamicKDTree : public BaseKNN<__T, __DT, __ST> {
+        public:
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
+        typedef KDTree<__T, __DT, __ST, __Distance, __Weight> tree_type;
+
+        /// @brief 以指定数据集，参数，权重策略和距离策略初始化，数据集中已有的记录构建为一棵树
+        /// @param __dataset 数据集，`insert`的记录追加至其末尾
+        /// @param __param 缓冲区与重建参数
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象，使用`FunctionalDistance`时可直接传入函数
+        DynamicKDTree(DataSet<__T, __ST>& __dataset, const DynamicKDTreeParam& __param = DynamicKDTreeParam(),
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            data_ptr = &__dataset;
+            param = __param;
+            param.buffer_size = std::max(1LL, param.buffer_size);
+            weight_func = __weight_func;
+            distance_func = __distance_func;
+            dimension = data_ptr->getDimension();
+            indexed = data_ptr->dataSize();
+            erased_cnt = 0;
+            erased.assign(indexed, 0);
+            where.assign(indexed, -1);
+            if (indexed > 0) {
+                std::vector<long long> all(indexed);
+                for (long long i = 0; i < indexed; ++i) all[i] = i;
+                int level = 0;
+                while ((param.buffer_size << level) < indexed) ++level;
+                levels.resize(level + 1);
+                dead.assign(level + 1, 0);
+                levels[level] = std::make_shared<const tree_type>(*data_ptr, all, nullptr, weight_func, distance_func);
+                std::fill(where.begin(), where.end(), level);
+            }
+            if (param.background) worker = std::thread([this]() { workerLoop(); });
+        }
+        DynamicKDTree(const DynamicKDTree&) = delete;
+        DynamicKDTree& operator=(const DynamicKDTree&) = delete;
+        ~DynamicKDTree() {
+            if (worker.joinable()) {
+                {
+                    std::lock_guard<std::mutex> guard(job_lock);
+                    stopping = true;
+                }
+                job_wake.notify_all();
+                worker.join();
+            }
+        }
+
+        const DataSet<__T, __ST>* getDatasetRef() const override {
+            return data_ptr;
+        }
+
+        /// @brief 获取结果，不保证返回数量为k
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void get(const std::vector<__T>& __vec, int k,
+                result_type& __container) override {
+            __container.clear();
+            if (k <= 0) return;
+            std::shared_lock<std::shared_mutex> guard(index_lock);
+            CandidateHeap<__DT>& tpk = CandidateHeap<__DT>::local(k);
+            searchAll(__vec, tpk, -1);
+            tpk.collect(data_ptr, __container);
+        }
+
+        /// @brief 多线程获取结果，规模足够大的层按`KDTree::multiThreadGet`的方式展开后并行搜索
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
+                            result_type& __container) override {
+            if (thread_cnt <= 1) {
+                this->get(__vec, k, __container);
+                return;
+            }
+            __container.clear();
+            if (k <= 0) return;
+            std::shared_lock<std::shared_mutex> guard(index_lock);
+            CandidateHeap<__DT> tpk(k);
+            searchAll(__vec, tpk, thread_cnt);
+            tpk.collect(data_ptr, __container);
+        }
+
+        /// @brief 插入一条记录，记录追加至数据集末尾
+        /// @return 记录在数据集中的下标
+        long long insert(const Record<__T, __ST>& __record) {
+            return insert(__record.vec, __record.state);
+        }
+        /// @brief 插入一条记录，记录追加至数据集末尾
+        /// @return 记录在数据集中的下标
+        long long insert(const std::vector<__T>& __vec, const __ST __state) {
+            long long id;
+            bool full;
+            {
+                std::unique_lock<std::shared_mutex> guard(index_lock);
+                data_ptr->appendRecord(__vec, __state);
+                id = data_ptr->dataSize() - 1;
+                full = appendPending();
+            }
+            if (full) schedule();
+            return id;
+        }
+        /// @brief 将数据集中在构建或上次同步之后由外部追加的记录加入索引
+        /// @return 新加入的记录数
+        long long sync() {
+            long long added;
+            bool full;
+            {
+                std::unique_lock<std::shared_mutex> guard(index_lock);
+                added = data_ptr->dataSize() - indexed;
+                full = appendPending();
+            }
+            if (full) schedule();
+            return std::max(0LL, added);
+        }
+        /// @brief 删除一条记录，此后的查询不再返回该记录
+        /// @param __id 记录在数据集中的下标
+        /// @return 记录存在且此前未被删除时返回`true`
+        bool erase(long long __id) {
+            bool sparse = false;
+            {
+                std::unique_lock<std::shared_mutex> guard(index_lock);
+                if (__id < 0 || __id >= indexed || erased[__id]) return false;
+                erased[__id] = 1;
+                ++erased_cnt;
+                int level = where[__id];
+                if (level >= 0) {
+                    ++dead[level];
+                    sparse = tooSparse(level);
+                }
+            }
+            if (sparse) schedule();
+            return true;
+        }
+        /// @brief 立即在当前线程上完成所有待进行的合并与重建
+        void flush() {
+            while (rebuildOnce()) {}
+        }
+
+        /// @brief 索引中未被删除的记录数
+        inline long long liveSize() const {
+            std::shared_lock<std::shared_mutex> guard(index_lock);
+            return indexed - erased_cnt;
+        }
+        inline const DynamicKDTreeParam& getParam() const { return param; }
+
+        private:
+        /// @brief 规模不低于该值的层在多线程查询时并行搜索
+        static constexpr long long parallel_cutoff = 4096;
+
+        /// @brief 一次重建：将`sources`中的各层与缓冲区中前`buffered`个点合并为第`target`层
+        struct Plan {
+            int target;
+            std::vector<int> sources;
+            std::size_t buffered;
+        };
+
+        /// @brief 将数据集中尚未加入索引的记录放入缓冲区，须持有`index_lock`
+        /// @return 缓冲区是否已满
+        bool appendPending() {
+            const long long tot = data_ptr->dataSize();
+            for (long long i = indexed; i < tot; ++i) {
+                erased.push_back(0);
+                where.push_back(-1);
+                buffer.push_back(i);
+            }
+            indexed = std::max(indexed, tot);
+            return static_cast<long long>(buffer.size()) >= param.buffer_size;
+        }
+        inline bool tooSparse(int __level) const {
+            return levels[__level] != nullptr &&
+                   dead[__level] > param.rebuild_ratio * levels[__level]->indexedSize();
+        }
+        /// @brief 选择下一次重建，缓冲区已满时优先合并，其次重建被删除的点过多的层
+        bool makePlan(Plan& __plan) const {
+            if (static_cast<long long>(buffer.size()) >= param.buffer_size) {
+                int target = 0;
+                while (target < static_cast<int>(levels.size()) && levels[target] != nullptr) ++target;
+                __plan.target = target;
+                __plan.sources.clear();
+                for (int l = 0; l < target; ++l) __plan.sources.push_back(l);
+                __plan.buffered = buffer.size();
+                return true;
+            }
+            for (int l = 0; l < static_cast<int>(levels.size()); ++l) {
+                if (tooSparse(l)) {
+                    __plan.target = l;
+                    __plan.sources.assign(1, l);
+                    __plan.buffered = 0;
+                    return true;
+                }
+            }
+            return false;
+        }
+        /// @brief 完成一次重建。收集点时持有共享锁，构建新树时不持有锁，替换各层时持有独占锁
+        /// @return 是否进行了重建
+        bool rebuildOnce() {
+            std::lock_guard<std::mutex> serial(rebuild_lock);
+            Plan plan;
+            std::vector<long long> subset;
+            std::vector<__T, AlignedAllocator<__T>> rows;
+            {
+                std::shared_lock<std::shared_mutex> guard(index_lock);
+                if (!makePlan(plan)) return false;
+                for (int l : plan.sources) {
+                    for (long long id : levels[l]->indexedIds()) {
+                        if (!erased[id]) subset.push_back(id);
+                    }
+                }
+                for (std::size_t i = 0; i < plan.buffered; ++i) {
+                    if (!erased[buffer[i]]) subset.push_back(buffer[i]);
+                }
+                rows.resize(subset.size() * dimension);
+                for (std::size_t i = 0; i < subset.size(); ++i) {
+                    const __T* __row = data_ptr->getRef(subset[i]).vec;
+                    std::copy(__row, __row + dimension, rows.begin() + i * dimension);
+                }
+            }
+            std::shared_ptr<const tree_type> tree;
+            if (!subset.empty()) {
+                tree = std::make_shared<const tree_type>(*data_ptr, subset, rows.data(), weight_func, distance_func);
+            }
+            std::unique_lock<std::shared_mutex> guard(index_lock);
+            buffer.erase(buffer.begin(), buffer.begin() + plan.buffered);
+            for (int l : plan.sources) {
+                levels[l].reset();
+                dead[l] = 0;
+            }
+            if (plan.target >= static_cast<int>(levels.size())) {
+                levels.resize(plan.target + 1);
+                dead.resize(plan.target + 1, 0);
+            }
+            levels[plan.target] = tree;
+            dead[plan.target] = 0;
+            if (tree != nullptr) {
+                // 收集之后被删除的点仍在新树中，计入该层的删除数
+                for (long long id : tree->indexedIds()) {
+                    where[id] = plan.target;
+                    if (erased[id]) ++dead[plan.target];
+                }
+            }
+            return true;
+        }
+        /// @brief 后台模式下唤醒工作线程，否则在当前线程上重建
+        void schedule() {
+            if (!param.background) {
+                flush();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> guard(job_lock);
+                requested = true;
+            }
+            job_wake.notify_one();
+        }
+        void workerLoop() {
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> guard(job_lock);
+                    job_wake.wait(guard, [this]() { return stopping || requested; });
+                    if (stopping) return;
+                    requested = false;
+                }
+                flush();
+            }
+        }
+
+        /// @brief 依次搜索缓冲区与由大到小的各层，须持有`index_lock`
+        void searchAll(const std::vector<__T>& __vec, CandidateHeap<__DT>& __tpk, int thread_cnt) const {
+            for (long long id : buffer) {
+                if (erased[id]) continue;
+                const __T* __row = data_ptr->getRef(id).vec;
+                __DT distance = weight_func.template weight<__DT>(
+                    distance_func.template distance<__DT>(__row, __vec.data(), dimension), __row, dimension);
+                __tpk.push(id, distance);
+            }
+            for (auto it = levels.rbegin(); it != levels.rend(); ++it) {
+                if (*it == nullptr) continue;
+                const int level_threads = ((*it)->indexedSize() >= parallel_cutoff) ? thread_cnt : -1;
+                (*it)->search(__vec, __tpk, level_threads, erased_cnt ? erased.data() : nullptr);
+            }
+        }
+
+        DataSet<__T, __ST>* data_ptr;
+        DynamicKDTreeParam param;
+        long long dimension;
+        /// @brief 已加入索引的记录数，即数据集中下标小于该值的记录
+        long long indexed;
+        long long erased_cnt;
+        /// @brief 以数据集下标索引的删除标记
+        std::vector<unsigned char> erased;
+        /// @brief 以数据集下标索引的记录所在层，-1表示在缓冲区中
+        std::vector<int> where;
+        /// @brief 尚未构建为树的记录下标
+        std::vector<long long> buffer;
+        /// @brief 第i层为空或为规模约`buffer_size * 2^i`的静态树
+        std::vector<std::shared_ptr<const tree_type>> levels;
+        /// @brief 各层中被删除的点数
+        std::vector<long long> dead;
+        __Weight weight_func;
+        __Distance distance_func;
+
+        /// @brief 查询持有共享锁，插入、删除与替换各层持有独占锁
+        mutable std::shared_mutex index_lock;
+        /// @brief 保证同一时刻至多进行一次重建
+        std::mutex rebuild_lock;
+        std::thread worker;
+        std::mutex job_lock;
+        std::condition_variable job_wake;
+        bool requested = false, stopping = false;
+    };
+
+    /// @brief Vantage-Point Tree法KNN，适用于任意满足三角不等式的距离
+    /// 每个内部结点以一个数据点为中心，按到该点距离的中位数`radius`将其余点分为内外两侧，
+    /// 子树规模不超过`leaf_size`时作为叶结点桶。结点与桶内向量均连续存放于树内部。
+    /// 仅当权重为`UniformWeight`时剪枝，否则遍历所有结点以保证结果精确
+    /// @tparam __T 数据集中的数据类型 `Type`
+    /// @tparam __DT 距离计算过程中的数据类型 `Distance Type`
+    /// @tparam __ST 数据分类的数据类型 `State Type`
+    /// @tparam __Distance 距离策略，须满足三角不等式，如`Euclidean`, `Manhattan`, `FunctionalDistance<__T, __DT>`
+    /// @tparam __Weight 权重策略，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = Euclidean, class __Weight = UniformWeight>
+    class VPTree : public BaseKNN<__T, __DT, __ST> {
+        static_assert(!std::is_same_v<__Distance, SquaredEuclidean> && !std::is_same_v<__Distance, Cosine>,
+                      "VPTree requires a metric distance, SquaredEuclidean and Cosine violate the triangle inequality");
+        public:
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
+        /// @brief 叶结点桶的最大容量
+        static constexpr long long leaf_size = 32;
+
+        /// @brief 以指定数据集，权重策略和距离策略初始化
+        /// @param __dataset 数据集
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象，使用`FunctionalDistance`时可直接传入函数
+        VPTree(const DataSet<__T, __ST>& __dataset,
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            data_ptr = &__dataset;
+            dimension = data_ptr->getDimension();
+            tot_samples = data_ptr->dataSize();
+            root = -1;
+
+            weight_func = __weight_func;
+            distance_func = __distance_func;
+            if (tot_samples <= 0) return;
+
+            ids.resize(tot_samples);
+            for (long long i = 0; i < tot_samples; ++i) {
+                ids[i] = i;
+            }
+            // 每个内部结点消耗一个中心点，结点数不超过数据量
+            nodes.resize(tot_samples);
+            node_cnt.store(0);
+            int parallel_depth = 0;
+            ThreadPool& pool = ThreadPool::global();
+            if (pool.size() > 1 && tot_samples >= 2 * parallel_cutoff) {
+                while ((1 << parallel_depth) < 4 * pool.size()) ++parallel_depth;
+            }
+            root = construct(0, tot_samples, 0, parallel_depth);
+            nodes.resize(node_cnt.load());
+
+            points.resize(tot_samples * dimension);
+            for (long long i = 0; i < tot_samples; ++i) {
+                const __T* __row = data_ptr->getRef(ids[i]).vec;
+                std::copy(__row, __row + dimension, points.begin() + i * dimension);
+            }
+        }
+
+        const DataSet<__T, __ST>* getDatasetRef() const override {
+            return data_ptr;
+        }
+
+        /// @brief 获取结果，不保证返回数量为k
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void get(const std::vector<__T>& __vec, int k,
+                result_type& __container) override {
+            __container.clear();
+            if (root < 0 || k <= 0) return;
+
+            CandidateHeap<__DT>& tpk = CandidateHeap<__DT>::local(k);
+            searchTree(root, __vec, tpk);
+            tpk.collect(data_ptr, __container);
+        }
+
+        /// @brief 多线程获取结果
+        ///        将树展开至不少于若干倍线程数的子树，展开路径上的中心点在当前线程上计算，
+        ///        各子树作为任务提交至全局线程池，任务间共享当前第k近距离的上界用于剪枝
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
+                            result_type& __container) override {
+            if (thread_cnt <= 1) {
+                this->get(__vec, k, __container);
+                return;
+            }
+            __container.clear();
+            if (root < 0 || k <= 0) return;
+
+            std::atomic<__DT> shared_bound(std::numeric_limits<__DT>::max());
+            CandidateHeap<__DT> tpk(k, &shared_bound);
+            std::vector<Frontier> frontier{Frontier{root, __DT{0}}};
+            const std::size_t target = 4 * static_cast<std::size_t>(thread_cnt);
+            while (frontier.size() < target) {
+                std::vector<Frontier> next;
+                next.reserve(frontier.size() * 2);
+                bool expanded = false;
+                for (const Frontier& f : frontier) {
+                    const VPNode& node = nodes[f.node];
+                    if (node.inside < 0) {
+                        next.push_back(f);
+                        continue;
+                    }
+                    expanded = true;
+                    __DT distance = visitCenter(node, __vec, tpk);
+                    next.push_back(Frontier{node.inside, std::max(f.bound, distance - node.radius)});
+                    next.push_back(Frontier{node.outside, std::max(f.bound, node.radius - distance)});
+                }
+                frontier.swap(next);
+                if (!expanded) break;
+            }
+            std::sort(frontier.begin(), frontier.end(),
+                      [](const Frontier& a, const Frontier& b) { return a.bound < b.bound; });
+
+            ThreadPool& pool = ThreadPool::global();
+            std::vector<std::future<CandidateHeap<__DT>>> rets;
+            rets.reserve(frontier.size());
+            for (const Frontier& f : frontier) {
+                rets.push_back(pool.submit([this, f, &__vec, k, &shared_bound]() {
+                    CandidateHeap<__DT> local(k, &shared_bound);
+                    if (reachable(f.bound, local)) searchTree(f.node, __vec, local);
+                    return local;
+                }));
+            }
+            for (auto& ret : rets) {
+                CandidateHeap<__DT> local = pool.wait(ret);
+                tpk.merge(local);
+            }
+            tpk.collect(data_ptr, __container);
+        }
+
+        private:
+        /// @brief 结点，`points`与`ids`中的`[begin, end)`属于该子树，内部结点的中心点位于`begin`
+        struct VPNode {
+            long long begin, end;
+            /// @brief 内侧子树中的点到中心点的距离不大于`radius`，外侧子树中的不小于`radius`
+            __DT radius;
+            /// @brief 子结点编号，叶结点为-1
+            long long inside, outside;
+        };
+        /// @brief 多线程查询时待搜索的子树，`bound`为该子树到查询点距离的下界
+        struct Frontier {
+            long long node;
+            __DT bound;
+        };
+        /// @brief 是否可依据三角不等式剪枝
+        static constexpr bool prunable = std::is_same_v<__Weight, UniformWeight>;
+        /// @brief 低于该规模的子树不再拆分为并行任务
+        static constexpr long long parallel_cutoff = 4096;
+
+        inline bool reachable(__DT __bound, const CandidateHeap<__DT>& __tpk) const {
+            if constexpr (prunable) {
+                return __bound < __tpk.bound();
+            } else {
+                return true;
+            }
+        }
+
+        /// @brief 构建覆盖`ids[begin, end)`的子树
+        /// @param parallel_depth 小于该深度且规模足够时，内侧子树作为任务提交至全局线程池
+        /// @return 子树根结点编号
+        long long construct(long long begin, long long end, int depth, int parallel_depth) {
+            long long id = node_cnt.fetch_add(1);
+            VPNode& node = nodes[id];
+            node.begin = begin;
+            node.end = end;
+            node.radius = __DT{0};
+            node.inside = node.outside = -1;
+            if (end - begin <= leaf_size) return id;
+
+            // 中心点由区间确定的伪随机数选取，构建结果与线程调度无关
+            std::minstd_rand gen(static_cast<unsigned>((begin * 2654435761LL) ^ end) | 1u);
+            std::swap(ids[begin], ids[begin + static_cast<long long>(gen() % (end - begin))]);
+            const __T* center = data_ptr->getRef(ids[begin]).vec;
+            std::vector<std::pair<__DT, long long>> dist(end - begin - 1);
+            for (long long i = begin + 1; i < end; ++i) {
+                dist[i - begin - 1] = std::make_pair(
+                    distance_func.template distance<__DT>(data_ptr->getRef(ids[i]).vec, center, dimension), ids[i]);
+            }
+            long long mid = static_cast<long long>(dist.size() >> 1);
+            std::nth_element(dist.begin(), dist.begin() + mid, dist.end(),
+                             [](const std::pair<__DT, long long>& a, const std::pair<__DT, long long>& b) {
+                                 return a.first < b.first;
+                             });
+            for (std::size_t i = 0; i < dist.size(); ++i) {
+                ids[begin + 1 + i] = dist[i].second;
+            }
+            node.radius = dist[mid].first;
+            long long split = begin + 1 + mid;
+            long long inside, outside;
+            if (depth < parallel_depth && end - begin >= parallel_cutoff) {
+                ThreadPool& pool = ThreadPool::global();
+                auto ret = pool.submit([this, begin, split, depth, parallel_depth]() {
+                    return construct(begin + 1, split, depth + 1, parallel_depth);
+                });
+                outside = construct(split, end, depth + 1, parallel_depth);
+                inside = pool.wait(ret);
+            } else {
+                inside = construct(begin + 1, split, depth + 1, parallel_depth);
+                outside = construct(split, end, depth + 1, parallel_depth);
+            }
+            nodes[id].inside = inside;
+            nodes[id].outside = outside;
+            return id;
+        }
+
+        /// @brief 计算中心点并加入候选
+        /// @return 查询点到中心点的距离（未经权重）
+        inline __DT visitCenter(const VPNode& __node, const std::vector<__T>& __vec, CandidateHeap<__DT>& __tpk) const {
+            const __T* __row = points.data() + __node.begin * dimension;
+            __DT distance = distance_func.template distance<__DT>(__row, __vec.data(), dimension);
+            __tpk.push(ids[__node.begin], weight_func.template weight<__DT>(distance, __row, dimension));
+            return distance;
+        }
+        void searchTree(long long __node, const std::vector<__T>& __vec, CandidateHeap<__DT>& __tpk) const {
+            const VPNode& node = nodes[__node];
+            if (node.inside < 0) {
+                for (long long i = node.begin; i < node.end; ++i) {
+                    const __T* __row = points.data() + i * dimension;
+                    __DT distance = weight_func.template weight<__DT>(
+                        distance_func.template distance<__DT>(__row, __vec.data(), dimension), __row, dimension);
+                    __tpk.push(ids[i], distance);
+                }
+                return ;
+            }
+            __DT distance = visitCenter(node, __vec, __tpk);
+            // 由三角不等式，内侧的点距离不小于distance - radius，外侧的点距离不小于radius - distance
+            if (distance < node.radius) {
+                searchTree(node.inside, __vec, __tpk);
+                if (reachable(node.radius - distance, __tpk)) searchTree(node.outside, __vec, __tpk);
+            } else {
+                searchTree(node.outside, __vec, __tpk);
+                if (reachable(distance - node.radius, __tpk)) searchTree(node.inside, __vec, __tpk);
+            }
+        }
+
+        long long dimension, tot_samples;
+        long long root;
+        std::vector<VPNode> nodes;
+        std::atomic<long long> node_cnt;
+        /// @brief 按子树顺序排列的点在原数据集中的下标
+        std::vector<long long> ids;
+        /// @brief 按子树顺序连续存放的向量
+        std::vector<__T, AlignedAllocator<__T>> points;
+        const DataSet<__T, __ST>* data_ptr;
+        __Weight weight_func;
+        __Distance distance_func;
+    };
+
+    /// @brief HNSW的构建与查询参数
+    struct HNSWParam {
+        /// @brief 上层每个结点的最大邻居数，第0层为其两倍
+        int M = 16;
+        /// @brief 构建时每层搜索保留的候选数
+        int ef_construction = 200;
+        /// @brief 查询时第0层保留的候选数，实际取`max(ef_search, k)`
+        int ef_search = 64;
+        /// @brief 结点层数的随机种子
+        unsigned long long seed = 100;
+    };
+
+    /// @brief Hierarchical Navigable Small World图法KNN，近似查询
+    /// 每个点以随机层数插入多层近邻图，查询从顶层入口贪心下降，在第0层以`ef_search`个候选做束搜索。
+    /// 构建时若全局线程池多于一个线程，则并行插入
+    /// @tparam __T 数据集中的数据类型 `Type`
+    /// @tparam __DT 距离计算过程中的数据类型 `Distance Type`
+    /// @tparam __ST 数据分类的数据类型 `State Type`
+    /// @tparam __Distance 距离策略，如`Euclidean`, `SquaredEuclidean`, `FunctionalDistance<__T, __DT>`
+    /// @tparam __Weight 权重策略，仅用于对第0层的候选排序，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = Euclidean, class __Weight = UniformWeight>
+    class HNSW : public BaseKNN<__T, __DT, __ST> {
+        public:
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
+
+        /// @brief 以指定数据集，参数，权重策略和距离策略初始化并构建图
+        /// @param __dataset 数据集
+        /// @param __param 构建与查询参数
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象，使用`FunctionalDistance`时可直接传入函数
+        HNSW(const DataSet<__T, __ST>& __dataset, const HNSWParam& __param = HNSWParam(),
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, __param, __weight_func, __distance_func);
+            build();
+        }
+        /// @brief 从`saveGraph`写入的流中读取图结构，与数据集不一致或数据损坏时重新构建，
+        ///        此时流被置为失败状态
+        /// @param __dataset 构建该图时使用的数据集
+        /// @param __graph_in 二进制输入流
+        HNSW(const DataSet<__T, __ST>& __dataset, std::ifstream& __graph_in,
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, HNSWParam(), __weight_func, __distance_func);
+            if (!loadGraph(__graph_in)) build();
+        }
+
+        const DataSet<__T, __ST>* getDatasetRef() const override {
+            return data_ptr;
+        }
+
+        /// @brief 获取近似结果
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void get(const std::vector<__T>& __vec, int k,
+                result_type& __container) override {
+            __container.clear();
+            if (tot_samples <= 0 || k <= 0) return;
+
+            const __T* q = __vec.data();
+            long long ep = entry;
+            __DT ep_dist = rawDistance(q, row(ep));
+            for (int level = max_level; level > 0; --level) {
+                greedySearch(q, ep, ep_dist, level);
+            }
+            std::vector<dist_pair> found = searchLayer(q, {dist_pair(ep_dist, ep)}, std::max(param.ef_search, k), 0);
+            CandidateHeap<__DT>& tpk = CandidateHeap<__DT>::local(k);
+            for (const dist_pair& c : found) {
+                const __T* __row = row(c.second);
+                tpk.push(c.second, weight_func.template weight<__DT>(c.first, __row, dimension));
+            }
+            tpk.collect(data_ptr, __container);
+        }
+
+        /// @brief 单个查询的图搜索无法有效拆分，等同于`get`，多个查询请使用`getBatch`
+        void multiThreadGet(const std::vector<__T>& __vec, int k, int,
+                            result_type& __container) override {
+            this->get(__vec, k, __container);
+        }
+
+        /// @brief 设置查询时第0层保留的候选数，越大越精确越慢
+        inline void setEfSearch(int __ef_search) { param.ef_search = std::max(1, __ef_search); }
+        inline const HNSWParam& getParam() const { return param; }
+
+        /// @brief 将图结构写入二进制流，不包含数据集本身
+        void saveGraph(std::ofstream& __out) const {
+            binaryWrite(param.M, __out);
+            binaryWrite(param.ef_construction, __out);
+            binaryWrite(param.ef_search, __out);
+            binaryWrite(tot_samples, __out);
+            binaryWrite(entry, __out);
+            binaryWrite(max_level, __out);
+            for (long long i = 0; i < tot_samples; ++i) {
+                binaryWrite(node_level[i], __out);
+                binaryWrite(level0_cnt[i], __out);
+                __out.write(reinterpret_cast<const char*>(level0.data() + i * max0), sizeof(long long) * level0_cnt[i]);
+                for (int l = 0; l < node_level[i]; ++l) {
+                    int cnt = static_cast<int>(upper[i][l].size());
+                    binaryWrite(cnt, __out);
+                    __out.write(reinterpret_cast<const char*>(upper[i][l].data()), sizeof(long long) * cnt);
+                }
+            }
+        }
+
+        private:
+        typedef std::pair<__DT, long long> dist_pair;
+        /// @brief 查询中已访问结点的标记，以轮次号代替清空
+        struct VisitedList {
+            std::vector<unsigned> tag;
+            unsigned epoch = 0;
+        };
+
+        void init(const DataSet<__T, __ST>& __dataset, const HNSWParam& __param,
+                  __Weight __weight_func, __Distance __distance_func) {
+            data_ptr = &__dataset;
+            dimension = data_ptr->getDimension();
+            tot_samples = data_ptr->dataSize();
+            rows = data_ptr->featureData();
+            param = __param;
+            param.M = std::max(2, param.M);
+            param.ef_construction = std::max(param.M, param.ef_construction);
+            param.ef_search = std::max(1, param.ef_search);
+            weight_func = __weight_func;
+            distance_func = __distance_func;
+            entry = 0;
+            max_level = 0;
+            building = false;
+        }
+        /// @brief 按当前`param.M`分配各结点的邻接存储
+        void allocate() {
+            max0 = 2 * param.M;
+            level0.assign(tot_samples * max0, 0);
+            level0_cnt.assign(tot_samples, 0);
+            upper.assign(tot_samples, {});
+            locks.reset(new std::mutex[std::max<long long>(tot_samples, 1)]);
+        }
+
+        void build() {
+            if (tot_samples <= 0) return;
+            node_level.resize(tot_samples);
+            std::mt19937_64 gen(param.seed);
+            std::uniform_real_distribution<double> uniform(0.0, 1.0);
+            const double level_mult = 1.0 / std::log(static_cast<double>(param.M));
+            for (long long i = 0; i < tot_samples; ++i) {
+                node_level[i] = static_cast<int>(-std::log(1.0 - uniform(gen)) * level_mult);
+            }
+            allocate();
+            for (long long i = 0; i < tot_samples; ++i) {
+                upper[i].resize(node_level[i]);
+            }
+            entry = 0;
+            max_level = node_level[0];
+
+            building = true;
+            ThreadPool& pool = ThreadPool::global();
+            int thread_cnt = (tot_samples >= parallel_cutoff) ? pool.size() : -1;
+            this->parallelChunks(tot_samples - 1, thread_cnt, [this](long long left, long long right) {
+                for (long long i = left; i < right; ++i) insertNode(i + 1);
+            });
+            building = false;
+        }
+
+        /// @brief 读取`saveGraph`写入的图结构，数据不一致或越界时返回`false`且不修改对象，
+        ///        流回到图结构的起点并置为失败状态
+        bool loadGraph(std::ifstream& __in) {
+            const std::streampos start = __in.tellg();
+            auto fail = [&__in, start]() {
+                __in.clear();
+                __in.seekg(start);
+                __in.setstate(std::ios::failbit);
+                return false;
+            };
+            HNSWParam file_param;
+            long long file_samples, file_entry;
+            int file_max_level;
+            binaryRead(file_param.M, __in);
+            binaryRead(file_param.ef_construction, __in);
+            binaryRead(file_param.ef_search, __in);
+            binaryRead(file_samples, __in);
+            binaryRead(file_entry, __in);
+            binaryRead(file_max_level, __in);
+            if (!__in || file_samples != tot_samples || file_samples <= 0 || file_param.M < 2 || file_param.M > max_M ||
+                file_entry < 0 || file_entry >= file_samples || file_max_level < 0 || file_max_level > max_levels) {
+                return fail();
+            }
+            file_param.ef_construction = std::max(file_param.M, file_param.ef_construction);
+            file_param.ef_search = std::max(1, file_param.ef_search);
+            const int file_max0 = 2 * file_param.M;
+            std::vector<int> file_node_level(file_samples);
+            std::vector<int> file_level0_cnt(file_samples);
+            std::vector<long long> file_level0(file_samples * file_max0, 0);
+            std::vector<std::vector<std::vector<long long>>> file_upper(file_samples);
+            for (long long i = 0; i < file_samples; ++i) {
+                int level, cnt;
+                binaryRead(level, __in);
+                binaryRead(cnt, __in);
+                if (!__in || level < 0 || level > file_max_level || cnt < 0 || cnt > file_max0) return fail();
+                file_node_level[i] = level;
+                file_level0_cnt[i] = cnt;
+                __in.read(reinterpret_cast<char*>(file_level0.data() + i * file_max0), sizeof(long long) * cnt);
+                file_upper[i].resize(level);
+                for (int l = 0; l < level; ++l) {
+                    binaryRead(cnt, __in);
+                    if (!__in || cnt < 0 || cnt > file_param.M) return fail();
+                    file_upper[i][l].resize(cnt);
+                    __in.read(reinterpret_cast<char*>(file_upper[i][l].data()), sizeof(long long) * cnt);
+                }
+                if (!__in) return fail();
+            }
+            // 邻居须在范围内，且在第l层出现的邻居自身的层数不低于l
+            if (file_node_level[file_entry] != file_max_level) return fail();
+            for (long long i = 0; i < file_samples; ++i) {
+                const long long* begin = file_level0.data() + i * file_max0;
+                for (int c = 0; c < file_level0_cnt[i]; ++c) {
+                    if (begin[c] < 0 || begin[c] >= file_samples) return fail();
+                }
+                for (int l = 0; l < file_node_level[i]; ++l) {
+                    for (long long nb : file_upper[i][l]) {
+                        if (nb < 0 || nb >= file_samples || file_node_level[nb] <= l) return fail();
+                    }
+                }
+            }
+            param = file_param;
+            entry = file_entry;
+            max_level = file_max_level;
+            max0 = file_max0;
+            node_level.swap(file_node_level);
+            level0_cnt.swap(file_level0_cnt);
+            level0.swap(file_level0);
+            upper.swap(file_upper);
+            locks.reset(new std::mutex[tot_samples]);
+            return true;
+        }
+
+        inline const __T* row(long long __index) const {
+            return (rows != nullptr) ? rows + __index * dimension : data_ptr->getRef(__index).vec;
+        }
+        inline __DT rawDistance(const __T* __a, const __T* __b) const {
+            return distance_func.template distance<__DT>(__a, __b, dimension);
+        }
+        /// @brief 复制结点在指定层的邻居，构建期间加锁
+        void neighbors(long long __index, int __level, std::vector<long long>& __out) const {
+            std::unique_lock<std::mutex> guard;
+            if (building) guard = std::unique_lock<std::mutex>(locks[__index]);
+            if (__level == 0) {
+                const long long* begin = level0.data() + __index * max0;
+                __out.assign(begin, begin + level0_cnt[__index]);
+            } else {
+                __out = upper[__index][__level - 1];
+            }
+        }
+
+        std::unique_ptr<VisitedList> acquireVisited() const {
+            std::unique_ptr<VisitedList> ret;
+            {
+                std::lock_guard<std::mutex> guard(visited_lock);
+                if (!visited_pool.empty()) {
+                    ret = std::move(visited_pool.back());
+                    visited_pool.pop_back();
+                }
+            }
+            if (!ret) {
+                ret.reset(new VisitedList());
+                ret->tag.assign(tot_samples, 0);
+            }
+            if (++ret->epoch == 0) {
+                std::fill(ret->tag.begin(), ret->tag.end(), 0);
+                ret->epoch = 1;
+            }
+            return ret;
+        }
+        void releaseVisited(std::unique_ptr<VisitedList> __visited) const {
+            std::lock_guard<std::mutex> guard(visited_lock);
+            visited_pool.push_back(std::move(__visited));
+        }
+
+        /// @brief 在指定层上从`__ep`出发贪心移动至局部最近点
+        void greedySearch(const __T* __q, long long& __ep, __DT& __ep_dist, int __level) const {
+            std::vector<long long> adj;
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                neighbors(__ep, __level, adj);
+                for (long long e : adj) {
+                    __DT d = rawDistance(__q, row(e));
+                    if (d < __ep_dist) {
+                        __ep_dist = d;
+                        __ep = e;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        /// @brief 在指定层上以`__ef`个候选做束搜索
+        /// @return 按距离升序排列的候选
+        std::vector<dist_pair> searchLayer(const __T* __q, const std::vector<dist_pair>& __eps,
+                                           int __ef, int __level) const {
+            std::unique_ptr<VisitedList> visited = acquireVisited();
+            std::priority_queue<dist_pair, std::vector<dist_pair>, std::greater<dist_pair>> candidates;
+            std::priority_queue<dist_pair> found;
+            for (const dist_pair& ep : __eps) {
+                if (visited->tag[ep.second] == visited->epoch) continue;
+                visited->tag[ep.second] = visited->epoch;
+                candidates.push(ep);
+                found.push(ep);
+                if (found.size() > static_cast<std::size_t>(__ef)) found.pop();
+            }
+            std::vector<long long> adj;
+            while (!candidates.empty()) {
+                dist_pair cur = candidates.top();
+                if (found.size() >= static_cast<std::size_t>(__ef) && found.top().first < cur.first) break;
+                candidates.pop();
+                neighbors(cur.second, __level, adj);
+                for (long long e : adj) {
+                    if (visited->tag[e] == visited->epoch) continue;
+                    visited->tag[e] = visited->epoch;
+                    __DT d = rawDistance(__q, row(e));
+                    if (found.size() < static_cast<std::size_t>(__ef) || d < found.top().first) {
+                        candidates.push(dist_pair(d, e));
+                        found.push(dist_pair(d, e));
+                        if (found.size() > static_cast<std::size_t>(__ef)) found.pop();
+                    }
+                }
+            }
+            releaseVisited(std::move(visited));
+            std::vector<dist_pair> ret(found.size());
+            for (std::size_t i = ret.size(); i > 0; --i) {
+                ret[i - 1] = found.top();
+                found.pop();
+            }
+            return ret;
+        }
+        /// @brief 启发式选取邻居：候选只有比已选中的点更接近基准点时才被选中，使邻居分布于不同方向
+        /// @param __candidates 按到基准点距离升序排列的候选
+        std::vector<long long> selectNeighbors(const std::vector<dist_pair>& __candidates, int __m) const {
+            std::vector<long long> chosen;
+            chosen.reserve(__m);
+            for (const dist_pair& c : __candidates) {
+                if (chosen.size() >= static_cast<std::size_t>(__m)) break;
+                bool good = true;
+                const __T* c_row = row(c.second);
+                for (long long s : chosen) {
+                    if (rawDistance(c_row, row(s)) < c.first) {
+                        good = false;
+                        break;
+                    }
+                }
+                if (good) chosen.push_back(c.second);
+            }
+            return chosen;
+        }
+        /// @brief 写入结点在指定层的邻居，并在各邻居处添加反向边，超出容量时重新选取
+        void connect(long long __index, int __level, const std::vector<long long>& __selected) {
+            const int cap = (__level == 0) ? max0 : param.M;
+            {
+                std::lock_guard<std::mutex> guard(locks[__index]);
+                setLinks(__index, __level, __selected);
+            }
+            std::vector<long long> adj;
+            for (long long e : __selected) {
+                std::lock_guard<std::mutex> guard(locks[e]);
+                if (__level == 0) {
+                    const long long* begin = level0.data() + e * max0;
+                    adj.assign(begin, begin + level0_cnt[e]);
+                } else {
+                    adj = upper[e][__level - 1];
+                }
+                if (std::find(adj.begin(), adj.end(), __index) != adj.end()) continue;
+                adj.push_back(__index);
+                if (static_cast<int>(adj.size()) > cap) {
+                    const __T* e_row = row(e);
+                    std::vector<dist_pair> cands;
+                    cands.reserve(adj.size());
+                    for (long long a : adj) cands.push_back(dist_pair(rawDistance(e_row, row(a)), a));
+                    std::sort(cands.begin(), cands.end());
+                    adj = selectNeighbors(cands, cap);
+                }
+                setLinks(e, __level, adj);
+            }
+        }
+        /// @brief 覆盖结点在指定层的邻居，调用方需持有该结点的锁
+        inline void setLinks(long long __index, int __level, const std::vector<long long>& __links) {
+            if (__level == 0) {
+                std::copy(__links.begin(), __links.end(), level0.begin() + __index * max0);
+                level0_cnt[__index] = static_cast<int>(__links.size());
+            } else {
+                upper[__index][__level - 1] = __links;
+            }
+        }
+        void insertNode(long long __index) {
+            const int level = node_level[__index];
+            // 新结点层数高于当前顶层时，持有入口锁直至成为新入口
+            std::unique_lock<std::mutex> entry_guard(entry_lock);
+            const int top_level = max_level;
+            long long ep = entry;
+            if (level <= top_level) entry_guard.unlock();
+
+            const __T* q = row(__index);
+            __DT ep_dist = rawDistance(q, row(ep));
+            for (int l = top_level; l > level; --l) {
+                greedySearch(q, ep, ep_dist, l);
+            }
+            std::vector<dist_pair> eps{dist_pair(ep_dist, ep)};
+            for (int l = std::min(level, top_level); l >= 0; --l) {
+                std::vector<dist_pair> found = searchLayer(q, eps, param.ef_construction, l);
+                connect(__index, l, selectNeighbors(found, param.M));
+                eps.swap(found);
+            }
+            if (level > top_level) {
+                entry = __index;
+                max_level = level;
+            }
+        }
+
+        template<class __WT>
+        void binaryWrite(const __WT& __data, std::ofstream& __ofs) const {
+            const char* x = reinterpret_cast<const char*>(&__data);
+            __ofs.write(x, sizeof(__WT));
+        }
+        template<class __RT>
+        void binaryRead(__RT& __val, std::ifstream& __ifs) const {
+            __ifs.read(reinterpret_cast<char*>(&__val), sizeof(__RT));
+        }
+
+        /// @brief 低于该数据量时不并行插入
+        static constexpr long long parallel_cutoff = 4096;
+        /// @brief 读取图结构时接受的`M`上限
+        static constexpr int max_M = 4096;
+        /// @brief 读取图结构时接受的层数上限，随机层数不超过`53 / ln(M)`
+        static constexpr int max_levels = 64;
+
+        long long dimension, tot_samples;
+        HNSWParam param;
+        long long entry;
+        int max_level;
+        /// @brief 第0层邻居的最大数量，为`2 * M`
+        int max0;
+        std::vector<int> node_level;
+        /// @brief 第0层邻接表，结点i的邻居位于`[i * max0, i * max0 + level0_cnt[i])`
+        std::vector<long long> level0;
+        std::vector<int> level0_cnt;
+        /// @brief `upper[i][l - 1]`为结点i在第l层的邻居
+        std::vector<std::vector<std::vector<long long>>> upper;
+        std::unique_ptr<std::mutex[]> locks;
+        std::mutex entry_lock;
+        bool building;
+        mutable std::mutex visited_lock;
+        mutable std::vector<std::unique_ptr<VisitedList>> visited_pool;
+        const __T* rows;
+        const DataSet<__T, __ST>* data_ptr;
+        __Weight weight_func;
+        __Distance distance_func;
+    };
+
+    /// @brief IVFPQ的构建与查询参数
+    struct IVFPQParam {
+        /// @brief 粗聚类的簇数，非正数时取数据量的平方根
+        int nlist = 0;
+        /// @brief 子空间数，即每个点的编码字节数，非正数时取`max(1, 维数 / 2)`
+        int m = 0;
+        /// @brief 每个子空间码本的位数，不超过8
+        int nbits = 8;
+        /// @brief 查询时搜索的簇数
+        int nprobe = 8;
+        /// @brief 以原始向量精确重排的候选数，非正数时不重排
+        int rerank = 0;
+        /// @brief 训练k-means使用的最大样本数
+        long long train_size = 16384;
+        int train_iterations = 20;
+        unsigned long long seed = 100;
+    };
+
+    /// @brief 倒排文件与乘积量化(IVF-PQ)法KNN，近似查询
+    /// 粗聚类将数据划分为`nlist`个簇，每个点相对所属簇质心的残差被切分为`m`个子空间并各以一个字节编码。
+    /// 查询时对最近的`nprobe`个簇，按残差查询向量建立非对称距离表，以查表求和估计距离；
+    /// 可选地用原始向量对前`rerank`个候选精确重排。距离策略须可按坐标轴分解。
+    /// 索引自带每个点的标签，以不含记录的数据集(`DefaultDataSet::saveToBin(out, false)`)载入时不需要原始向量，此时不能重排
+    /// @tparam __T 数据集中的数据类型 `Type`
+    /// @tparam __DT 距离计算过程中的数据类型，同时是质心与码本的数据类型 `Distance Type`
+    /// @tparam __ST 数据分类的数据类型 `State Type`
+    /// @tparam __Distance 距离策略，须提供`term`与`fromTerms`，如`Euclidean`, `SquaredEuclidean`, `Manhattan`
+    /// @tparam __Weight 权重策略，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = SquaredEuclidean, class __Weight = UniformWeight>
+    class IVFPQ : public BaseKNN<__T, __DT, __ST> {
+        static_assert(has_axis_terms<__Distance, __DT>::value,
+                      "IVFPQ requires a distance policy decomposable per axis (term / fromTerms)");
+        public:
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
+
+        /// @brief 以指定数据集，参数，权重策略和距离策略初始化并训练、编码
+        /// @param __dataset 数据集
+        /// @param __param 构建与查询参数
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象
+        IVFPQ(const DataSet<__T, __ST>& __dataset, const IVFPQParam& __param = IVFPQParam(),
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, __param, __weight_func, __distance_func);
+            build();
+        }
+        /// @brief 从`saveIndex`写入的流中读取质心、码本、编码与标签，与数据集不一致时重新构建。
+        ///        `__dataset`不含记录而索引非空时，索引脱离原始向量单独使用，结果的`vec`为`nullptr`
+        /// @param __dataset 构建该索引时使用的数据集，或只保存了维度与标准化参数的数据集
+        /// @param __index_in 二进制输入流
+        IVFPQ(const DataSet<__T, __ST>& __dataset, std::ifstream& __index_in,
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, IVFPQParam(), __weight_func, __distance_func);
+            if (!loadIndex(__index_in)) {
+                init(__dataset, IVFPQParam(), __weight_func, __distance_func);
+                build();
+            }
+        }
+
+        const DataSet<__T, __ST>* getDatasetRef() const override {
+            return data_ptr;
+        }
+
+        /// @brief 获取近似结果
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void get(const std::vector<__T>& __vec, int k,
+                result_type& __container) override {
+            __container.clear();
+            if (tot_samples <= 0 || k <= 0) return;
+            std::vector<int> probes = probeLists(__vec);
+            CandidateHeap<__DT> approx(std::max(k, param.rerank));
+            scanLists(__vec, probes, 0, probes.size(), approx);
+            finish(__vec, approx, k, __container);
+        }
+
+        /// @brief 多线程获取结果，搜索的各簇作为任务提交至全局线程池
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
+                            result_type& __container) override {
+            if (thread_cnt <= 1) {
+                this->get(__vec, k, __container);
+                return;
+            }
+            __container.clear();
+            if (tot_samples <= 0 || k <= 0) return;
+            std::vector<int> probes = probeLists(__vec);
+            const int keep = std::max(k, param.rerank);
+            std::atomic<__DT> shared_bound(std::numeric_limits<__DT>::max());
+            CandidateHeap<__DT> approx(keep, &shared_bound);
+            std::mutex merge_lock;
+            this->parallelChunks(probes.size(), thread_cnt, [&](long long left, long long right) {
+                CandidateHeap<__DT> local(keep, &shared_bound);
+                scanLists(__vec, probes, left, right, local);
+                std::lock_guard<std::mutex> guard(merge_lock);
+                approx.merge(local);
+            });
+            finish(__vec, approx, k, __container);
+        }
+
+        inline void setNprobe(int __nprobe) { param.nprobe = std::max(1, std::min(__nprobe, nlist)); }
+        /// @brief 设置重排的候选数，索引不含原始向量时保持为0
+        inline void setRerank(int __rerank) { param.rerank = detached ? 0 : std::max(0, __rerank); }
+        inline const IVFPQParam& getParam() const { return param; }
+        /// @brief 索引是否脱离原始向量单独使用
+        inline bool isDetached() const { return detached; }
+
+        /// @brief 将质心、码本、编码与每个点的标签写入二进制流，不包含原始向量
+        void saveIndex(std::ofstream& __out) const {
+            binaryWrite(tot_samples, __out);
+            binaryWrite(dimension, __out);
+            binaryWrite(nlist, __out);
+            binaryWrite(m, __out);
+            binaryWrite(ksub, __out);
+            binaryWrite(param.nbits, __out);
+            binaryWrite(param.nprobe, __out);
+            binaryWrite(param.rerank, __out);
+            writeBlock(coarse, __out);
+            writeBlock(codebooks, __out);
+            writeBlock(list_offset, __out);
+            writeBlock(ids, __out);
+            writeBlock(codes, __out);
+            writeLabels(__out);
+        }
+
+        private:
+        void init(const DataSet<__T, __ST>& __dataset, const IVFPQParam& __param,
+                  __Weight __weight_func, __Distance __distance_func) {
+            data_ptr = &__dataset;
+            dimension = data_ptr->getDimension();
+            tot_samples = data_ptr->dataSize();
+            param = __param;
+            weight_func = __weight_func;
+            distance_func = __distance_func;
+            nlist = m = ksub = 0;
+            detached = false;
+            label_table.clear();
+            point_labels.clear();
+        }
+        /// @brief 子空间s覆盖的维度为`[s * dimension / m, (s + 1) * dimension / m)`
+        inline long long subBegin(int __s) const { return __s * dimension / m; }
+
+        void build() {
+            if (tot_samples <= 0 || dimension <= 0) return;
+            nlist = (param.nlist > 0) ? param.nlist
+                    : static_cast<int>(std::max(1.0, std::sqrt(static_cast<double>(tot_samples))));
+            nlist = static_cast<int>(std::min<long long>(nlist, tot_samples));
+            m = (param.m > 0) ? param.m : static_cast<int>(std::max<long long>(1, dimension / 2));
+            m = static_cast<int>(std::min<long long>(m, dimension));
+            param.nbits = std::max(1, std::min(param.nbits, 8));
+            param.nprobe = std::max(1, std::min(param.nprobe, nlist));
+            param.rerank = std::max(0, param.rerank);
+            ThreadPool& pool = ThreadPool::global();
+            const int thread_cnt = (tot_samples >= parallel_cutoff) ? pool.size() : -1;
+            std::mt19937_64 gen(param.seed);
+
+            // 训练样本
+            const long long train_cnt = std::min(tot_samples, std::max<long long>(param.train_size, nlist));
+            std::vector<long long> sample(tot_samples);
+            for (long long i = 0; i < tot_samples; ++i) sample[i] = i;
+            std::shuffle(sample.begin(), sample.end(), gen);
+            sample.resize(train_cnt);
+            std::vector<__DT> train(train_cnt * dimension);
+            for (long long i = 0; i < train_cnt; ++i) {
+                const __T* __row = data_ptr->getRef(sample[i]).vec;
+                for (long long j = 0; j < dimension; ++j) train[i * dimension + j] = static_cast<__DT>(__row[j]);
+            }
+            // 粗聚类，再以训练样本的残差训练每个子空间的码本
+            kMeans(train, train_cnt, dimension, nlist, param.train_iterations, gen, coarse, thread_cnt);
+            std::vector<int> train_assign(train_cnt);
+            this->parallelChunks(train_cnt, thread_cnt, [&](long long left, long long right) {
+                for (long long i = left; i < right; ++i) {
+                    const __DT* x = train.data() + i * dimension;
+                    train_assign[i] = nearest(x, coarse.data(), nlist, dimension);
+                    const __DT* c = coarse.data() + static_cast<long long>(train_assign[i]) * dimension;
+                    for (long long j = 0; j < dimension; ++j) train[i * dimension + j] = x[j] - c[j];
+                }
+            });
+            ksub = static_cast<int>(std::min<long long>(1LL << param.nbits, train_cnt));
+            codebooks.assign(ksub * dimension, __DT{0});
+            for (int s = 0; s < m; ++s) {
+                const long long begin = subBegin(s), sub_dim = subBegin(s + 1) - begin;
+                std::vector<__DT> sub(train_cnt * sub_dim);
+                for (long long i = 0; i < train_cnt; ++i) {
+                    std::copy(train.begin() + i * dimension + begin, train.begin() + i * dimension + begin + sub_dim,
+                              sub.begin() + i * sub_dim);
+                }
+                std::vector<__DT> book;
+                kMeans(sub, train_cnt, sub_dim, ksub, param.train_iterations, gen, book, thread_cnt);
+                std::copy(book.begin(), book.end(), codebooks.begin() + ksub * begin);
+            }
+
+            // 所有点分配至簇并编码残差
+            std::vector<int> assign(tot_samples);
+            std::vector<std::uint8_t> point_codes(tot_samples * m);
+            this->parallelChunks(tot_samples, thread_cnt, [&](long long left, long long right) {
+                std::vector<__DT> x(dimension);
+                for (long long i = left; i < right; ++i) {
+                    const __T* __row = data_ptr->getRef(i).vec;
+                    for (long long j = 0; j < dimension; ++j) x[j] = static_cast<__DT>(__row[j]);
+                    assign[i] = nearest(x.data(), coarse.data(), nlist, dimension);
+                    const __DT* c = coarse.data() + static_cast<long long>(assign[i]) * dimension;
+                    for (long long j = 0; j < dimension; ++j) x[j] -= c[j];
+                    encode(x.data(), point_codes.data() + i * m);
+                }
+            });
+            list_offset.assign(nlist + 1, 0);
+            for (long long i = 0; i < tot_samples; ++i) list_offset[assign[i] + 1] += 1;
+            for (int c = 0; c < nlist; ++c) list_offset[c + 1] += list_offset[c];
+            std::vector<long long> fill(list_offset.begin(), list_offset.end() - 1);
+            ids.resize(tot_samples);
+            codes.resize(tot_samples * m);
+            for (long long i = 0; i < tot_samples; ++i) {
+                long long pos = fill[assign[i]]++;
+                ids[pos] = i;
+                std::copy(point_codes.begin() + i * m, point_codes.begin() + (i + 1) * m, codes.begin() + pos * m);
+            }
+        }
+
+        /// @brief Lloyd k-means，质心以不同样本初始化，空簇以随机样本重新初始化
+        static void kMeans(const std::vector<__DT>& __data, long long __n, long long __dim, int __k, int __iterations,
+                           std::mt19937_64& __gen, std::vector<__DT>& __centroids, int thread_cnt) {
+            __centroids.resize(static_cast<long long>(__k) * __dim);
+            std::vector<long long> order(__n);
+            for (long long i = 0; i < __n; ++i) order[i] = i;
+            std::shuffle(order.begin(), order.end(), __gen);
+            for (int c = 0; c < __k; ++c) {
+                std::copy(__data.begin() + order[c] * __dim, __data.begin() + (order[c] + 1) * __dim,
+                          __centroids.begin() + c * __dim);
+            }
+            std::vector<int> assign(__n, -1);
+            std::vector<__DT> sums(__centroids.size());
+            std::vector<long long> counts(__k);
+            std::uniform_int_distribution<long long> pick(0, __n - 1);
+            for (int iter = 0; iter < __iterations; ++iter) {
+                std::atomic<long long> changed(0);
+                BaseKNN<__T, __DT, __ST>::parallelChunks(__n, thread_cnt, [&](long long left, long long right) {
+                    long long local = 0;
+                    for (long long i = left; i < right; ++i) {
+                        int c = nearest(__data.data() + i * __dim, __centroids.data(), __k, __dim);
+                        if (c != assign[i]) {
+                            assign[i] = c;
+                            ++local;
+                        }
+                    }
+                    changed += local;
+                });
+                if (changed.load() == 0) break;
+                std::fill(sums.begin(), sums.end(), __DT{0});
+                std::fill(counts.begin(), counts.end(), 0);
+                for (long long i = 0; i < __n; ++i) {
+                    counts[assign[i]] += 1;
+                    for (long long j = 0; j < __dim; ++j) sums[assign[i] * __dim + j] += __data[i * __dim + j];
+                }
+                for (int c = 0; c < __k; ++c) {
+                    if (counts[c] == 0) {
+                        long long r = pick(__gen);
+                        std::copy(__data.begin() + r * __dim, __data.begin() + (r + 1) * __dim,
+                                  __centroids.begin() + c * __dim);
+                        continue;
+                    }
+                    for (long long j = 0; j < __dim; ++j) {
+                        __centroids[c * __dim + j] = sums[c * __dim + j] / static_cast<__DT>(counts[c]);
+                    }
+                }
+            }
+        }
+        /// @brief 平方欧氏距离最近的质心
+        static int nearest(const __DT* __x, const __DT* __centroids, int __k, long long __dim) {
+            int best = 0;
+            __DT best_dist = std::numeric_limits<__DT>::max();
+            for (int c = 0; c < __k; ++c) {
+                __DT d = squaredEuclidean<__DT, __DT>(__x, __centroids + c * __dim, __dim);
+                if (d < best_dist) {
+                    best_dist = d;
+                    best = c;
+                }
+            }
+            return best;
+        }
+        /// @brief 以每个子空间最近的码字编码残差
+        void encode(const __DT* __residual, std::uint8_t* __code) const {
+            for (int s = 0; s < m; ++s) {
+                const long long begin = subBegin(s), sub_dim = subBegin(s + 1) - begin;
+                __code[s] = static_cast<std::uint8_t>(
+                    nearest(__residual + begin, codebooks.data() + ksub * begin, ksub, sub_dim));
+            }
+        }
+
+        /// @brief 按距离策略选出离查询点最近的`nprobe`个簇
+        std::vector<int> probeLists(const std::vector<__T>& __vec) const {
+            std::vector<std::pair<__DT, int>> dist(nlist);
+            for (int c = 0; c < nlist; ++c) {
+                const __DT* centroid = coarse.data() + static_cast<long long>(c) * dimension;
+                __DT sum{0};
+                for (long long j = 0; j < dimension; ++j) {
+                    sum += distance_func.template term<__DT>(static_cast<__DT>(__vec[j]) - centroid[j]);
+                }
+                dist[c] = std::make_pair(sum, c);
+            }
+            const int probe_cnt = std::min(param.nprobe, nlist);
+            std::partial_sort(dist.begin(), dist.begin() + probe_cnt, dist.end());
+            std::vector<int> ret(probe_cnt);
+            for (int i = 0; i < probe_cnt; ++i) ret[i] = dist[i].second;
+            return ret;
+        }
+        /// @brief 以非对称距离表扫描`__probes[left, right)`中的簇，候选距离为各子空间`term`之和
+        void scanLists(const std::vector<__T>& __vec, const std::vector<int>& __probes,
+                       long long left, long long right, CandidateHeap<__DT>& __approx) const {
+            std::vector<__DT> residual(dimension);
+            std::vector<__DT> table(static_cast<long long>(m) * ksub);
+            for (long long p = left; p < right; ++p) {
+                const int list = __probes[p];
+                const __DT* centroid = coarse.data() + static_cast<long long>(list) * dimension;
+                for (long long j = 0; j < dimension; ++j) residual[j] = static_cast<__DT>(__vec[j]) - centroid[j];
+                for (int s = 0; s < m; ++s) {
+                    const long long begin = subBegin(s), sub_dim = subBegin(s + 1) - begin;
+                    const __DT* book = codebooks.data() + ksub * begin;
+                    for (int c = 0; c < ksub; ++c) {
+                        __DT sum{0};
+                        for (long long j = 0; j < sub_dim; ++j) {
+                            sum += distance_func.template term<__DT>(residual[begin + j] - book[c * sub_dim + j]);
+                        }
+                        table[s * ksub + c] = sum;
+                    }
+                }
+                for (long long pos = list_offset[list]; pos < list_offset[list + 1]; ++pos) {
+                    const std::uint8_t* code = codes.data() + pos * m;
+                    __DT sum{0};
+                    for (int s = 0; s < m; ++s) sum += table[s * ksub + code[s]];
+                    __approx.push(ids[pos], sum);
+                }
+            }
+        }
+        /// @brief 由近似候选得到最终结果：重排时以原始向量精确计算，否则使用估计距离。
+        ///        索引不含原始向量时，权重策略收到的记录为`nullptr`，结果的标签取自索引自带的标签表
+        void finish(const std::vector<__T>& __vec, CandidateHeap<__DT>& __approx, int k,
+                    result_type& __container) const {
+            CandidateHeap<__DT> tpk(k);
+            for (const auto& candidate : __approx.take()) {
+                const __T* __row = detached ? nullptr : data_ptr->getRef(candidate.first).vec;
+                __DT distance = (param.rerank > 0)
+                                ? distance_func.template distance<__DT>(__row, __vec.data(), dimension)
+                                : distance_func.template fromTerms<__DT>(candidate.second);
+                tpk.push(candidate.first, weight_func.template weight<__DT>(distance, __row, dimension));
+            }
+            if (!detached) {
+                tpk.collect(data_ptr, __container);
+                return;
+            }
+            for (const auto& candidate : tpk.take()) {
+                const std::uint32_t label = point_labels[candidate.first];
+                __container.push_back(RecordView<__T, __ST>{nullptr, &label_table.at(label), dimension,
+                                                            candidate.first, label});
+            }
+        }
+
+        template<class __V>
+        void writeBlock(const __V& __block, std::ofstream& __out) const {
+            long long size = __block.size();
+            binaryWrite(size, __out);
+            __out.write(reinterpret_cast<const char*>(__block.data()), sizeof(typename __V::value_type) * size);
+        }
+        template<class __V>
+        bool readBlock(__V& __block, long long __expect, std::ifstream& __in) const {
+            long long size;
+            binaryRead(size, __in);
+            if (!__in || size != __expect) return false;
+            __block.resize(size);
+            __in.read(reinterpret_cast<char*>(__block.data()), sizeof(typename __V::value_type) * size);
+            return static_cast<bool>(__in);
+        }
+        bool loadIndex(std::ifstream& __in) {
+            long long file_samples, file_dimension;
+            binaryRead(file_samples, __in);
+            binaryRead(file_dimension, __in);
+            // 数据集不含记录时单独使用索引
+            const bool shell = (tot_samples == 0 && file_samples > 0);
+            if (!__in || file_dimension != dimension || (file_samples != tot_samples && !shell)) return false;
+            tot_samples = file_samples;
+            binaryRead(nlist, __in);
+            binaryRead(m, __in);
+            binaryRead(ksub, __in);
+            binaryRead(param.nbits, __in);
+            binaryRead(param.nprobe, __in);
+            binaryRead(param.rerank, __in);
+            if (!__in || nlist <= 0 || nlist > tot_samples || m <= 0 || m > dimension || ksub <= 0 || ksub > 256) return false;
+            // 码本大小不超过`2^nbits`，查询参数与构建时一样限制在有效范围内
+            if (param.nbits < 1 || param.nbits > 8 || ksub > (1 << param.nbits)) return false;
+            param.nprobe = std::max(1, std::min(param.nprobe, nlist));
+            param.rerank = std::max(0, param.rerank);
+            if (!readBlock(coarse, nlist * dimension, __in) ||
+                !readBlock(codebooks, ksub * dimension, __in) ||
+                !readBlock(list_offset, nlist + 1LL, __in) ||
+                !readBlock(ids, tot_samples, __in) ||
+                !readBlock(codes, tot_samples * m, __in)) return false;
+            if (list_offset.front() != 0 || list_offset.back() != tot_samples) return false;
+            for (int c = 0; c < nlist; ++c) {
+                if (list_offset[c] > list_offset[c + 1]) return false;
+            }
+            for (long long id : ids) {
+                if (id < 0 || id >= tot_samples) return false;
+            }
+            for (std::uint8_t code : codes) {
+                if (code >= ksub) return false;
+            }
+            if (!readLabels(__in, shell)) return false;
+            detached = shell;
+            if (detached) param.rerank = 0;
+            return true;
+        }
+
+        /// @brief 写入每个点的标签：先是标签表，再是以点的下标排列的标签编号
+        void writeLabels(std::ofstream& __out) const {
+            LabelTable<__ST> bound_table;
+            std::vector<std::uint32_t> bound_ids;
+            if (!detached) {
+                bound_ids.resize(tot_samples);
+                for (long long i = 0; i < tot_samples; ++i) {
+                    const __ST* state = data_ptr->getRef(i).state;
+                    bound_ids[i] = bound_table.intern(state ? *state : __ST{});
+                }
+            }
+            const LabelTable<__ST>& table = detached ? label_table : bound_table;
+            binaryWrite(static_cast<std::uint32_t>(table.size()), __out);
+            for (std::size_t i = 0; i < table.size(); ++i) {
+                const __ST& label = table.at(static_cast<std::uint32_t>(i));
+                if constexpr (std::is_arithmetic_v<__ST>) {
+                    binaryWrite(label, __out);
+                } else {
+                    binaryWrite(static_cast<std::uint32_t>(label.size()), __out);
+                    __out.write(label.data(), label.size());
+                }
+            }
+            writeBlock(detached ? point_labels : bound_ids, __out);
+        }
+        /// @brief 读取`writeLabels`写入的标签，`__keep`为`false`时只校验并跳过
+        bool readLabels(std::ifstream& __in, bool __keep) {
+            constexpr std::uint32_t max_label_size = 1u << 20;
+            std::uint32_t table_size;
+            binaryRead(table_size, __in);
+            if (!__in || table_size > static_cast<std::uint64_t>(tot_samples)) return false;
+            LabelTable<__ST> table;
+            for (std::uint32_t i = 0; i < table_size; ++i) {
+                __ST label{};
+                if constexpr (std::is_arithmetic_v<__ST>) {
+                    binaryRead(label, __in);
+                } else {
+                    std::uint32_t size;
+                    binaryRead(size, __in);
+                    if (!__in || size > max_label_size) return false;
+                    label.resize(size);
+                    __in.read(label.data(), size);
+                }
+                if (!__in || table.intern(label) != i) return false;
+            }
+            std::vector<std::uint32_t> point_ids;
+            if (!readBlock(point_ids, tot_samples, __in)) return false;
+            for (std::uint32_t id : point_ids) {
+                if (id >= table_size) return false;
+            }
+            if (__keep) {
+                label_table = std::move(table);
+                point_labels.swap(point_ids);
+            }
+            return true;
+        }
+
+        template<class __WT>
+        void binaryWrite(const __WT& __data, std::ofstream& __ofs) const {
+            const char* x = reinterpret_cast<const char*>(&__data);
+            __ofs.write(x, sizeof(__WT));
+        }
+        template<class __RT>
+        void binaryRead(__RT& __val, std::ifstream& __ifs) const {
+            __ifs.read(reinterpret_cast<char*>(&__val), sizeof(__RT));
+        }
+
+        /// @brief 低于该数据量时不并行训练与编码
+        static constexpr long long parallel_cutoff = 4096;
+
+        long long dimension, tot_samples;
+        IVFPQParam param;
+        int nlist, m, ksub;
+        /// @brief 粗聚类质心，`nlist * dimension`
+        std::vector<__DT> coarse;
+        /// @brief 子空间s的第c个码字位于`ksub * subBegin(s) + c * 子空间维数`
+        std::vector<__DT> codebooks;
+        /// @brief 第c个簇的点位于`[list_offset[c], list_offset[c + 1])`
+        std::vector<long long> list_offset;
+        /// @brief 按簇排列的点在原数据集中的下标
+        std::vector<long long> ids;
+        /// @brief 按簇排列的编码，每个点`m`字节
+        std::vector<std::uint8_t> codes;
+        /// @brief 索引不含原始向量，结果的标签取自`label_table`与`point_labels`
+        bool detached;
+        LabelTable<__ST> label_table;
+        /// @brief 以点的下标排列的标签编号，只在`detached`时保存
+        std::vector<std::uint32_t> point_labels;
         const DataSet<__T, __ST>* data_ptr;
-        std::function<__DT(__DT, const std::vector<__T>*)> weight_func;
-        std::function<__DT(const std::vector<__T>*, const std::vector<__T>*)> distance_func;
+        __Weight weight_func;
+        __Distance distance_func;
     };
 
-    /// @brief 向量排序使用的比较
-    template<class __T, class __ST>
-    class KDSort {
-        public:
-        KDSort(long long __dimension) {
-            dim = __dimension;
-        }
-        bool operator() (const Record<__T, __ST>* left, const Record<__T, __ST>* right) {
-            if (left->vec.at(dim) < right->vec.at(dim)) return true;
-            return false;
-        }
-        private:
-        long long dim;
+    /// @brief LSH的构建与查询参数
+    struct LSHParam {
+        /// @brief 哈希表数量
+        int tables = 8;
+        /// @brief 每个表拼接的哈希函数数量
+        int bits = 12;
+        /// @brief 查询时每个表除自身所在桶外额外探测的桶数
+        int probes = 8;
+        /// @brief p-stable投影的桶宽，非正数时按数据采样估计
+        double bucket_width = 0;
+        unsigned long long seed = 100;
     };
 
-    /// @brief K-Dimension Tree法KNN
+    /// @brief 局部敏感哈希(LSH)法KNN，近似查询
+    /// `Cosine`使用随机超平面的符号，`Manhattan`使用Cauchy分布(1-stable)的随机投影，其余距离使用高斯分布(2-stable)的随机投影，
+    /// 每个表以`bits`个哈希值的组合作为桶号。查询时按扰动得分依次探测每个表中相邻的桶(multi-probe)，再对候选精确计算距离；
+    /// 候选不足k个时退化为线性扫描。哈希表只保存下标，数据集追加记录后以`sync`加入索引，每条记录的代价与数据量无关
     /// @tparam __T 数据集中的数据类型 `Type`
     /// @tparam __DT 距离计算过程中的数据类型 `Distance Type`
     /// @tparam __ST 数据分类的数据类型 `State Type`
-    template<class __T = double, class __DT = __T, class __ST = int>
-    class KDTree : public BaseKNN<__T, __DT, __ST>{
+    /// @tparam __Distance 距离策略，如`Cosine`, `Euclidean`, `SquaredEuclidean`, `Manhattan`, `FunctionalDistance<__T, __DT>`
+    /// @tparam __Weight 权重策略，如`UniformWeight`, `FunctionalWeight<__T, __DT>`
+    template<class __T = double, class __DT = __T, class __ST = int,
+             class __Distance = Euclidean, class __Weight = UniformWeight>
+    class LSH : public BaseKNN<__T, __DT, __ST> {
         public:
-        /// @brief 以指定数据集，权重函数和距离函数初始化
-        /// @param __dataset 数据集
-        /// @param __weight_func 权重函数，类型为`__DT(__DT, const std::vector<__T>*)`
-        /// @param __distance_func 距离函数，类型为`__DT(const std::vector<__T>*, const std::vector<__T>*)`
-        KDTree(const DataSet<__T, __ST>& __dataset, 
-            std::function<__DT(__DT, const std::vector<__T>*)> __weight_func = uniformWeight<__T, __DT>,
-            std::function<__DT(const std::vector<__T>*, const std::vector<__T>*)> __distance_func = euclidean<__T, __DT>) {
-            data_ptr = &__dataset;
-            dimension = data_ptr->getDimension();
-            std::vector<const Record<__T, __ST>*> __vec;
-            root = new KDNode<__T, __ST>();
-
-            weight_func = __weight_func;
-            distance_func = __distance_func;
-            __vec.reserve(data_ptr->dataSize());
-            root->father = root;
-            for (long long i = 0; i < data_ptr->dataSize(); ++i) {
-                __vec.push_back(data_ptr->getRef(i));
-            }
+        typedef typename BaseKNN<__T, __DT, __ST>::result_type result_type;
 
-            sort(__vec.begin(), __vec.end(), KDSort<__T, __ST>(0));
-            long long mid = (__vec.size() >> 1);
-            root->rec_ptr = __vec[mid];
-            root->left_ptr = construct(__vec, 1, __vec.begin(), __vec.begin() + mid, root);
-            root->right_ptr = construct(__vec, 1, __vec.begin() + mid + 1, __vec.end(), root);
+        /// @brief 以指定数据集，参数，权重策略和距离策略初始化并构建哈希表
+        /// @param __dataset 数据集，可在构建后继续追加记录
+        /// @param __param 构建与查询参数
+        /// @param __weight_func 权重策略对象，使用`FunctionalWeight`时可直接传入函数
+        /// @param __distance_func 距离策略对象，使用`FunctionalDistance`时可直接传入函数
+        LSH(const DataSet<__T, __ST>& __dataset, const LSHParam& __param = LSHParam(),
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, __param, __weight_func, __distance_func);
+            build();
         }
-        ~KDTree(){
-            if (root != nullptr) {
-                deconstruct(root);
-                root = nullptr;
-            }
+        /// @brief 从`saveIndex`写入的流中读取参数并重新构建，哈希函数由种子确定，与保存前一致
+        /// @param __dataset 构建该索引时使用的数据集
+        /// @param __index_in 二进制输入流
+        LSH(const DataSet<__T, __ST>& __dataset, std::ifstream& __index_in,
+            __Weight __weight_func = __Weight(), __Distance __distance_func = __Distance()) {
+            init(__dataset, LSHParam(), __weight_func, __distance_func);
+            if (!loadParam(__index_in)) param = LSHParam();
+            build();
         }
 
         const DataSet<__T, __ST>* getDatasetRef() const override {
             return data_ptr;
         }
-        
-        /// @brief 获取结果，不保证返回数量为k
+
+        /// @brief 获取近似结果
         /// @param __vec 预测的向量
         /// @param k 参数k
-        /// @param __container 储存结果的容器，类型为`std::vector<const Record<__T, __ST>*>`
-        void get(const std::vector<__T>& __vec, int k, 
-                std::vector<const Record<__T, __ST>*>& __container) override {
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
+        void get(const std::vector<__T>& __vec, int k,
+                result_type& __container) override {
             __container.clear();
-
-            tpk_type tpk;
-            searchTree(root, __vec, 0, tpk, k);
-            __container.resize(tpk.size());
-            while (tpk.size()) {
-                __container[tpk.size() - 1] = tpk.top().first;
-                tpk.pop();
-            }
+            if (indexed <= 0 || k <= 0) return;
+            std::vector<long long> candidates;
+            probeTables(__vec, 0, param.tables, candidates);
+            finish(__vec, candidates, k, -1, __container);
         }
-        
-        /// @brief 仅作为方法占位，KDTree不提供多线程查询
+
+        /// @brief 多线程获取结果，各哈希表的探测与候选的距离计算分块提交至全局线程池
+        /// @param __vec 预测的向量
+        /// @param k 参数k
+        /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+        /// @param __container 储存结果的容器，类型为`std::vector<RecordView<__T, __ST>>`
         void multiThreadGet(const std::vector<__T>& __vec, int k, int thread_cnt,
-                            std::vector<const Record<__T, __ST>*>& __container) override {
-            this->get(__vec, k, __container);
+                            result_type& __container) override {
+            if (thread_cnt <= 1) {
+                this->get(__vec, k, __container);
+                return;
+            }
+            __container.clear();
+            if (indexed <= 0 || k <= 0) return;
+            std::vector<long long> candidates;
+            std::mutex merge_lock;
+            this->parallelChunks(param.tables, thread_cnt, [&](long long left, long long right) {
+                std::vector<long long> local;
+                probeTables(__vec, static_cast<int>(left), static_cast<int>(right), local);
+                std::lock_guard<std::mutex> guard(merge_lock);
+                candidates.insert(candidates.end(), local.begin(), local.end());
+            });
+            finish(__vec, candidates, k, thread_cnt, __container);
         }
 
-        private:
-        typedef typename std::vector<const Record<__T, __ST>*>::iterator vec_it;
-        typedef std::pair<const Record<__T, __ST>*, __DT> d_pair;
-        struct KDHeap {
-            bool operator()(const d_pair& left, const d_pair& right) {
-                if (left.second < right.second) return true;
-                return false;
+        /// @brief 将数据集中构建或上次同步之后追加的记录加入哈希表
+        /// @return 新加入的记录数
+        long long sync() {
+            const long long tot = data_ptr->dataSize();
+            if (tot <= indexed) return 0;
+            if (planes.empty()) {
+                build();
+                return indexed;
             }
-        };
-        typedef std::priority_queue<d_pair, std::vector<d_pair>, KDHeap> tpk_type;
-
-        KDNode<__T, __ST>* construct(std::vector<const Record<__T, __ST>*>& __vec,
-                                    int depth, vec_it left, vec_it right, KDNode<__T, __ST>* fa) {
-            if (left == right) return nullptr;
-            KDNode<__T, __ST>* ptr = new KDNode<__T, __ST>();
-            ptr->father = fa;
-            if (right - left == 1) {
-                ptr->rec_ptr = *left;
-            } else {
-                std::sort(left, right, KDSort<__T, __ST>(depth % dimension));
-                long long mid = ((right - left) >> 1);
-                ptr->rec_ptr = *(left + mid);
-                ptr->left_ptr = construct(__vec, depth + 1, left, left + mid, ptr);
-                ptr->right_ptr = construct(__vec, depth + 1, left + mid + 1, right, ptr);
+            std::vector<std::uint64_t> keys(param.tables);
+            for (long long i = indexed; i < tot; ++i) {
+                hashRecord(data_ptr->getRef(i).vec, keys.data(), 1);
+                for (int t = 0; t < param.tables; ++t) buckets[t][keys[t]].push_back(i);
             }
-            return ptr;
+            const long long added = tot - indexed;
+            indexed = tot;
+            return added;
         }
-        void deconstruct(KDNode<__T, __ST>* ptr) {
-            if (ptr->left_ptr != nullptr) deconstruct(ptr->left_ptr);
-            if (ptr->right_ptr != nullptr) deconstruct(ptr->right_ptr);
-            delete ptr;
+
+        inline void setProbes(int __probes) { param.probes = std::max(0, std::min(__probes, max_probes)); }
+        inline const LSHParam& getParam() const { return param; }
+        /// @brief 已加入哈希表的记录数
+        inline long long indexedSize() const { return indexed; }
+
+        /// @brief 将参数写入二进制流，哈希表在读取时由种子重新构建，不包含数据集本身
+        void saveIndex(std::ofstream& __out) const {
+            binaryWrite(param.tables, __out);
+            binaryWrite(param.bits, __out);
+            binaryWrite(param.probes, __out);
+            binaryWrite(param.bucket_width, __out);
+            binaryWrite(param.seed, __out);
+        }
+
+        private:
+        /// @brief 哈希函数族
+        enum class Family { Hyperplane, Gaussian, Cauchy };
+        static constexpr Family family = std::is_same_v<__Distance, Cosine> ? Family::Hyperplane
+                                       : std::is_same_v<__Distance, Manhattan> ? Family::Cauchy : Family::Gaussian;
+        /// @brief 一个扰动：将第`bit`个哈希值移动`delta`，得分越小越可能包含近邻
+        struct Perturbation {
+            __DT score;
+            int bit, delta;
+            bool operator<(const Perturbation& __other) const { return score < __other.score; }
+        };
+
+        void init(const DataSet<__T, __ST>& __dataset, const LSHParam& __param,
+                  __Weight __weight_func, __Distance __distance_func) {
+            data_ptr = &__dataset;
+            param = __param;
+            weight_func = __weight_func;
+            distance_func = __distance_func;
+            indexed = 0;
         }
-        void searchTree(const KDNode<__T, __ST>* __present, const std::vector<__T>& __vec,
-                    int depth, tpk_type& __tpk, const int k) {
 
-            long long index = depth % dimension;
-            __DT distance = weight_func(distance_func(&(__present->rec_ptr->vec), &__vec), &__vec);
-            bool left_flg = (__vec[index] < __present->rec_ptr->vec[index]) ? true : false;
+        void build() {
+            const long long tot = data_ptr->dataSize();
+            dimension = data_ptr->getDimension();
+            planes.clear();
+            buckets.clear();
+            indexed = 0;
+            if (tot <= 0 || dimension <= 0) return;
+            param.tables = std::max(1, std::min(param.tables, max_tables));
+            param.bits = std::max(1, std::min(param.bits, 64));
+            param.probes = std::max(0, std::min(param.probes, max_probes));
+            makeFunctions();
 
-            if (__present->left_ptr == nullptr && __present->right_ptr == nullptr) {
-                if (__tpk.size() < k) __tpk.push(std::make_pair(__present->rec_ptr, distance));
-                else if (distance < __tpk.top().second) {
-                    __tpk.pop();
-                    __tpk.push(std::make_pair(__present->rec_ptr, distance));
-                }
-                return ;
-            }
-            
-            if (left_flg) {
-                if (__present->left_ptr != nullptr) {
-                    searchTree(__present->left_ptr, __vec, depth + 1, __tpk, k);
+            // 各点的哈希互不相关，先并行计算所有桶号，再由各表独立地填充
+            ThreadPool& pool = ThreadPool::global();
+            const int thread_cnt = (tot >= parallel_cutoff) ? pool.size() : -1;
+            std::vector<std::uint64_t> keys(tot * param.tables);
+            this->parallelChunks(tot, thread_cnt, [&](long long left, long long right) {
+                for (long long i = left; i < right; ++i) hashRecord(data_ptr->getRef(i).vec, keys.data() + i, tot);
+            });
+            buckets.resize(param.tables);
+            this->parallelChunks(param.tables, thread_cnt, [&](long long left, long long right) {
+                for (long long t = left; t < right; ++t) {
+                    const std::uint64_t* table_keys = keys.data() + t * tot;
+                    for (long long i = 0; i < tot; ++i) buckets[t][table_keys[i]].push_back(i);
                 }
+            });
+            indexed = tot;
+        }
+
+        /// @brief 以种子生成所有表的投影向量与偏移，p-stable族的桶宽未指定时由采样估计
+        void makeFunctions() {
+            std::mt19937_64 gen(param.seed);
+            const long long func_cnt = static_cast<long long>(param.tables) * param.bits;
+            planes.resize(func_cnt * dimension);
+            offsets.assign(func_cnt, __DT{0});
+            if constexpr (family == Family::Cauchy) {
+                std::cauchy_distribution<double> stable(0.0, 1.0);
+                for (auto& x : planes) x = static_cast<__DT>(stable(gen));
             } else {
-                if (__present->right_ptr != nullptr) {
-                    searchTree(__present->right_ptr, __vec, depth + 1, __tpk, k);
-                }
+                std::normal_distribution<double> stable(0.0, 1.0);
+                for (auto& x : planes) x = static_cast<__DT>(stable(gen));
+            }
+            if constexpr (family != Family::Hyperplane) {
+                if (param.bucket_width <= 0) param.bucket_width = estimateWidth();
+                std::uniform_real_distribution<double> shift(0.0, param.bucket_width);
+                for (auto& b : offsets) b = static_cast<__DT>(shift(gen));
             }
-            
-            if (__tpk.size() < k) {
-                __tpk.push(std::make_pair(__present->rec_ptr, distance));
-            } else if (distance < __tpk.top().second) {
-                __tpk.pop();
-                __tpk.push(std::make_pair(__present->rec_ptr, distance));
+        }
+        /// @brief 以等距采样点间的平均最近距离估计桶宽，使拼接多个哈希函数后近邻仍有较高的碰撞概率。
+        ///        高斯投影取L2距离的4倍，Cauchy投影的尾部更重，取L1距离的16倍
+        double estimateWidth() const {
+            const long long tot = data_ptr->dataSize();
+            const long long sample_cnt = std::min<long long>(tot, 512), query_cnt = std::min<long long>(sample_cnt, 64);
+            if (sample_cnt < 2) return 1.0;
+            std::vector<const __T*> sample(sample_cnt);
+            for (long long i = 0; i < sample_cnt; ++i) sample[i] = data_ptr->getRef(i * tot / sample_cnt).vec;
+            double sum = 0;
+            for (long long i = 0; i < query_cnt; ++i) {
+                double best = std::numeric_limits<double>::max();
+                for (long long j = 0; j < sample_cnt; ++j) {
+                    if (i == j) continue;
+                    double d = (family == Family::Cauchy) ? manhattan<__T, double>(sample[i], sample[j], dimension)
+                                                          : euclidean<__T, double>(sample[i], sample[j], dimension);
+                    best = std::min(best, d);
+                }
+                sum += best;
             }
+            const double scale = (family == Family::Cauchy) ? 16.0 : 4.0;
+            return (sum > 0) ? scale * sum / query_cnt : 1.0;
+        }
 
-            bool next_flg = false;
-            if (std::abs(__vec[index] - __present->rec_ptr->vec[index]) < __tpk.top().second) {
-                next_flg = true;
+        /// @brief 第`__func`个哈希函数的投影值，p-stable族以桶宽为单位
+        inline __DT project(const __T* __vec, long long __func) const {
+            const __DT* plane = planes.data() + __func * dimension;
+            __DT dot{0};
+            for (long long j = 0; j < dimension; ++j) dot += plane[j] * static_cast<__DT>(__vec[j]);
+            if constexpr (family == Family::Hyperplane) return dot;
+            else return (dot + offsets[__func]) / static_cast<__DT>(param.bucket_width);
+        }
+        inline long long slotOf(__DT __projection) const {
+            if constexpr (family == Family::Hyperplane) return __projection >= __DT{0};
+            else return static_cast<long long>(std::floor(__projection));
+        }
+        /// @brief 将一个表的各哈希值组合为64位桶号
+        static std::uint64_t combine(const long long* __slots, int __bits) {
+            std::uint64_t key = 0xcbf29ce484222325ULL;
+            for (int b = 0; b < __bits; ++b) {
+                key ^= static_cast<std::uint64_t>(__slots[b]);
+                key *= 0x100000001b3ULL;
+                key ^= key >> 29;
+            }
+            return key;
+        }
+        /// @brief 计算一条记录在每个表中的桶号，第t个表的桶号写入`__keys[t * __stride]`
+        void hashRecord(const __T* __vec, std::uint64_t* __keys, long long __stride) const {
+            std::vector<long long> slots(param.bits);
+            for (int t = 0; t < param.tables; ++t) {
+                for (int b = 0; b < param.bits; ++b) {
+                    slots[b] = slotOf(project(__vec, static_cast<long long>(t) * param.bits + b));
+                }
+                __keys[t * __stride] = combine(slots.data(), param.bits);
             }
+        }
+
+        /// @brief 探测`[left, right)`号表，将所在桶及按扰动得分排序的前`probes`个相邻桶中的下标加入`__candidates`
+        void probeTables(const std::vector<__T>& __vec, int left, int right, std::vector<long long>& __candidates) const {
+            std::vector<__DT> projection(param.bits);
+            std::vector<long long> slots(param.bits), probe_slots(param.bits);
+            std::vector<Perturbation> moves;
+            for (int t = left; t < right; ++t) {
+                for (int b = 0; b < param.bits; ++b) {
+                    projection[b] = project(__vec.data(), static_cast<long long>(t) * param.bits + b);
+                    slots[b] = slotOf(projection[b]);
+                }
+                appendBucket(t, combine(slots.data(), param.bits), __candidates);
+                if (param.probes <= 0) continue;
 
-            if (next_flg) {
-                if (left_flg) {
-                    if (__present->right_ptr != nullptr) {
-                        searchTree(__present->right_ptr, __vec, depth + 1, __tpk, k);
+                // 移动每个哈希值的代价：超平面为投影到平面的距离，p-stable为到相邻桶边界距离的平方
+                moves.clear();
+                for (int b = 0; b < param.bits; ++b) {
+                    if constexpr (family == Family::Hyperplane) {
+                        moves.push_back({static_cast<__DT>(std::abs(projection[b])), b, 0});
+                    } else {
+                        __DT low = projection[b] - static_cast<__DT>(slots[b]), high = __DT{1} - low;
+                        moves.push_back({low * low, b, -1});
+                        moves.push_back({high * high, b, 1});
                     }
-                } else {
-                    if (__present->left_ptr != nullptr) {
-                        searchTree(__present->left_ptr, __vec, depth + 1, __tpk, k);
+                }
+                std::sort(moves.begin(), moves.end());
+
+                // 以最小堆按总得分从小到大生成扰动集合(shift/expand)，集合以`moves`中的下标升序表示
+                typedef std::pair<__DT, std::vector<int>> scored_set;
+                auto greater = [](const scored_set& x, const scored_set& y) { return x.first > y.first; };
+                std::priority_queue<scored_set, std::vector<scored_set>, decltype(greater)> sets(greater);
+                sets.push(scored_set(moves[0].score, {0}));
+                const int move_cnt = static_cast<int>(moves.size());
+                for (int probed = 0; probed < param.probes && !sets.empty(); ) {
+                    scored_set cur = sets.top();
+                    sets.pop();
+                    const int last = cur.second.back();
+                    if (last + 1 < move_cnt) {
+                        scored_set shifted = cur, expanded = cur;
+                        shifted.second.back() = last + 1;
+                        shifted.first += moves[last + 1].score - moves[last].score;
+                        expanded.second.push_back(last + 1);
+                        expanded.first += moves[last + 1].score;
+                        sets.push(std::move(shifted));
+                        sets.push(std::move(expanded));
                     }
+                    // 同一哈希值的两个方向不能同时移动
+                    probe_slots = slots;
+                    bool valid = true;
+                    for (int idx : cur.second) {
+                        const Perturbation& move = moves[idx];
+                        if (probe_slots[move.bit] != slots[move.bit]) {
+                            valid = false;
+                            break;
+                        }
+                        probe_slots[move.bit] = (family == Family::Hyperplane) ? 1 - slots[move.bit]
+                                                                               : slots[move.bit] + move.delta;
+                    }
+                    if (!valid) continue;
+                    appendBucket(t, combine(probe_slots.data(), param.bits), __candidates);
+                    ++probed;
                 }
-            } else return;
+            }
+        }
+        inline void appendBucket(int __table, std::uint64_t __key, std::vector<long long>& __candidates) const {
+            auto it = buckets[__table].find(__key);
+            if (it != buckets[__table].end()) __candidates.insert(__candidates.end(), it->second.begin(), it->second.end());
         }
 
-        long long dimension;
-        KDNode<__T, __ST>* root;
+        /// @brief 去重后精确计算候选的距离，候选不足k个时扫描所有已索引的记录
+        void finish(const std::vector<__T>& __vec, std::vector<long long>& __candidates, int k, int thread_cnt,
+                    result_type& __container) const {
+            std::sort(__candidates.begin(), __candidates.end());
+            __candidates.erase(std::unique(__candidates.begin(), __candidates.end()), __candidates.end());
+            if (static_cast<long long>(__candidates.size()) < std::min<long long>(k, indexed)) {
+                __candidates.resize(indexed);
+                for (long long i = 0; i < indexed; ++i) __candidates[i] = i;
+            }
+            std::atomic<__DT> shared_bound(std::numeric_limits<__DT>::max());
+            CandidateHeap<__DT> tpk(k, thread_cnt > 1 ? &shared_bound : nullptr);
+            std::mutex merge_lock;
+            this->parallelChunks(__candidates.size(), thread_cnt, [&](long long left, long long right) {
+                CandidateHeap<__DT> local(k, thread_cnt > 1 ? &shared_bound : nullptr);
+                for (long long i = left; i < right; ++i) {
+                    const __T* __row = data_ptr->getRef(__candidates[i]).vec;
+                    __DT distance = distance_func.template distance<__DT>(__row, __vec.data(), dimension);
+                    local.push(__candidates[i], weight_func.template weight<__DT>(distance, __row, dimension));
+                }
+                std::lock_guard<std::mutex> guard(merge_lock);
+                tpk.merge(local);
+            });
+            tpk.collect(data_ptr, __container);
+        }
+
+        /// @brief 读取`saveIndex`写入的参数，超出范围时返回`false`且不修改`param`
+        bool loadParam(std::ifstream& __in) {
+            LSHParam file_param;
+            binaryRead(file_param.tables, __in);
+            binaryRead(file_param.bits, __in);
+            binaryRead(file_param.probes, __in);
+            binaryRead(file_param.bucket_width, __in);
+            binaryRead(file_param.seed, __in);
+            if (!__in || file_param.tables < 1 || file_param.tables > max_tables ||
+                file_param.bits < 1 || file_param.bits > 64 ||
+                file_param.probes < 0 || file_param.probes > max_probes ||
+                !std::isfinite(file_param.bucket_width)) return false;
+            param = file_param;
+            return true;
+        }
+
+        template<class __WT>
+        void binaryWrite(const __WT& __data, std::ofstream& __ofs) const {
+            const char* x = reinterpret_cast<const char*>(&__data);
+            __ofs.write(x, sizeof(__WT));
+        }
+        template<class __RT>
+        void binaryRead(__RT& __val, std::ifstream& __ifs) const {
+            __ifs.read(reinterpret_cast<char*>(&__val), sizeof(__RT));
+        }
+
+        /// @brief 低于该数据量时不并行构建
+        static constexpr long long parallel_cutoff = 4096;
+        /// @brief 哈希表数与探测数的上限，构建时截断，读取参数时超出则拒绝
+        static constexpr int max_tables = 1024;
+        static constexpr int max_probes = 1 << 16;
+
+        long long dimension = 0, indexed = 0;
+        LSHParam param;
+        /// @brief 第t个表第b个哈希函数的投影向量位于`(t * bits + b) * dimension`
+        std::vector<__DT> planes;
+        /// @brief p-stable投影的随机偏移，在`[0, bucket_width)`中均匀选取
+        std::vector<__DT> offsets;
+        /// @brief 每个表中桶号到记录下标的映射
+        std::vector<std::unordered_map<std::uint64_t, std::vector<long long>>> buckets;
         const DataSet<__T, __ST>* data_ptr;
-        std::function<__DT(__DT, const std::vector<__T>*)> weight_func;
-        std::function<__DT(const std::vector<__T>*, const std::vector<__T>*)> distance_func;
+        __Weight weight_func;
+        __Distance distance_func;
     };
 
+    /// @brief 以`std::function`指定距离与权重的暴力法KNN
+    template<class __T = double, class __DT = __T, class __ST = int>
+    using FunctionalBrute = Brute<__T, __DT, __ST, FunctionalDistance<__T, __DT>, FunctionalWeight<__T, __DT>>;
+    /// @brief 以`std::function`指定距离与权重的KD树KNN
+    template<class __T = double, class __DT = __T, class __ST = int>
+    using FunctionalKDTree = KDTree<__T, __DT, __ST, FunctionalDistance<__T, __DT>, FunctionalWeight<__T, __DT>>;
+    /// @brief 以`std::function`指定距离与权重的动态KD树KNN
+    template<class __T = double, class __DT = __T, class __ST = int>
+    using FunctionalDynamicKDTree = DynamicKDTree<__T, __DT, __ST, FunctionalDistance<__T, __DT>, FunctionalWeight<__T, __DT>>;
+    /// @brief 以`std::function`指定距离与权重的VP树KNN，距离函数须满足三角不等式
+    template<class __T = double, class __DT = __T, class __ST = int>
+    using FunctionalVPTree = VPTree<__T, __DT, __ST, FunctionalDistance<__T, __DT>, FunctionalWeight<__T, __DT>>;
+    /// @brief 以`std::function`指定距离与权重的HNSW
+    template<class __T = double, class __DT = __T, class __ST = int>
+    using FunctionalHNSW = HNSW<__T, __DT, __ST, FunctionalDistance<__T, __DT>, FunctionalWeight<__T, __DT>>;
+    /// @brief 以`std::function`指定距离与权重的LSH，使用高斯分布的随机投影
+    template<class __T = double, class __DT = __T, class __ST = int>
+    using FunctionalLSH = LSH<__T, __DT, __ST, FunctionalDistance<__T, __DT>, FunctionalWeight<__T, __DT>>;
+
     /// @brief 分割字符串
     /// @param __str 原字符串
     /// @param __container 存储结果的容器
@@ -807,6 +4389,9 @@ namespace knn {
             return Record<__T, __ST>{__vec, label};
         }
 
+        inline char separator() const { return sep; }
+        inline long long getDimension() const { return dimension; }
+
         private:
         char sep;
         long long dimension;
@@ -859,53 +4444,383 @@ namespace knn {
         }
     }
 
+    /// @brief 扫描文本文件，对每一行调用`__func(begin, end)`，行尾不含换行符。
+    /// 能映射时直接扫描映射的内存，否则按块读入并保留跨块的半行；行尾由`memchr`查找
+    /// @param __filename 文件名
+    /// @param __func 对每一行执行的函数
+    template<class __F>
+    void scanLines(const char* __filename, __F&& __func) {
+        auto scan = [&__func](const char* __cur, const char* __end) {
+            while (__cur < __end) {
+                auto nl = static_cast<const char*>(std::memchr(__cur, '\n', __end - __cur));
+                if (nl == nullptr) return __cur;
+                __func(__cur, nl);
+                __cur = nl + 1;
+            }
+            return __cur;
+        };
+        if (auto file = MappedFile::open(__filename)) {
+            const char* end = file->data() + file->size();
+            const char* rest = scan(file->data(), end);
+            if (rest < end) __func(rest, end);
+            return;
+        }
+        std::ifstream ifs(__filename, std::ios::in | std::ios::binary);
+        if (!ifs.is_open()) return;
+        std::vector<char> buffer(1 << 22);
+        std::size_t kept = 0;
+        while (ifs) {
+            // 单行比缓冲区长时扩大缓冲区
+            if (kept == buffer.size()) buffer.resize(buffer.size() * 2);
+            ifs.read(buffer.data() + kept, buffer.size() - kept);
+            const char* end = buffer.data() + kept + ifs.gcount();
+            const char* rest = scan(buffer.data(), end);
+            kept = end - rest;
+            std::memmove(buffer.data(), rest, kept);
+        }
+        if (kept) __func(buffer.data(), buffer.data() + kept);
+    }
+
+    /// @brief 直接从字节区间解析一个字段
+    template<class __T>
+    inline void parseField(const char* __begin, const char* __end, __T& __value) {
+        if constexpr (std::is_integral_v<__T> || std::is_floating_point_v<__T>) {
+            if (__begin < __end && *__begin == '+') ++__begin;
+#if __cpp_lib_to_chars >= 201611L
+            __value = __T{};
+            std::from_chars(__begin, __end, __value);
+#else
+            fromStr(std::string(__begin, __end), __value);
+#endif
+        } else {
+            __value.assign(__begin, __end - __begin);
+        }
+    }
+
+    /// @brief 去掉行尾的`'\r'`后判断是否为空行，空行不产生记录
+    inline bool trimLine(const char* __begin, const char*& __end) {
+        if (__begin < __end && __end[-1] == '\r') --__end;
+        return __begin < __end;
+    }
+
+    /// @brief 将一行解析到给定的特征行与标签，与`splitString`一致地跳过空字段，缺少的特征保持为零
+    /// @param __sep 分隔符，为负数时按空白字符分隔
+    /// @param __dimension 特征数
+    /// @param __row 长度为`__dimension`的特征行
+    /// @param __label 标签
+    template<class __T, class __ST>
+    void parseCsvLine(const char* __begin, const char* __end, char __sep, long long __dimension,
+                      __T* __row, __ST& __label) {
+        auto is_blank = [__sep](char __c) {
+            return (__sep < 0) ? (__c == ' ' || __c == '\t') : (__c == ' ' && __sep != ' ');
+        };
+        const char* cur = __begin;
+        long long field = 0;
+        while (field <= __dimension && cur < __end) {
+            while (cur < __end && is_blank(*cur)) ++cur;
+            const char* stop;
+            if (__sep < 0) {
+                stop = cur;
+                while (stop < __end && !is_blank(*stop)) ++stop;
+            } else {
+                stop = static_cast<const char*>(std::memchr(cur, __sep, __end - cur));
+                if (stop == nullptr) stop = __end;
+            }
+            const char* last = stop;
+            while (last > cur && is_blank(last[-1])) --last;
+            if (last > cur) {
+                if (field < __dimension) parseField(cur, last, __row[field]);
+                else parseField(cur, last, __label);
+                ++field;
+            }
+            cur = (stop < __end) ? stop + 1 : __end;
+        }
+    }
+
+    /// @brief 类csv文件的布局：开头需跳过的行数与特征数
+    struct CsvLayout {
+        int skipped = 0;
+        long long dimension = 0;
+        /// @brief 用于推断的第一条数据行
+        std::string first_line;
+    };
+
+    /// @brief 推断类csv文件的布局。除最后一个字段外全为数字的第一行视为数据的开始，
+    /// 之前的行（表头与空行）都被跳过；最后一个字段为标签
+    /// @param __filename 文件名
+    /// @param __sep 分隔符，为负数时按空白字符分隔
+    inline CsvLayout detectCsvLayout(const char* __filename, char __sep = -1) {
+        CsvLayout layout;
+        std::ifstream check_in(__filename, std::ios::in);
+        std::string check_buf;
+        std::vector<std::string> check_list;
+        while (std::getline(check_in, check_buf)) {
+            if (!check_buf.empty() && check_buf.back() == '\r') check_buf.pop_back();
+            splitString(check_buf, check_list, __sep);
+            bool valid = !check_list.empty();
+            for (std::size_t index = 0; index + 1 < check_list.size() && valid; ++index) {
+                for (char chr : check_list[index]) {
+                    if (!((chr >= '0' && chr <= '9') || chr == '.' || chr == '-' || chr == '+' || chr == 'e' || chr == 'E')) {
+                        valid = false;
+                        break;
+                    }
+                }
+            }
+            if (valid) {
+                layout.dimension = static_cast<long long>(check_list.size()) - 1;
+                layout.first_line = check_buf;
+                return layout;
+            }
+            ++layout.skipped;
+        }
+        return layout;
+    }
+
+    template<class __T, class __ST>
+    /// @brief 从文件中读入数据集（针对默认数据集与默认行读取重载）。
+    /// 不逐行构造字符串与`Record`，字段直接由字节区间解析并写入数据集的特征缓冲区。
+    /// 多线程时将映射的文件按换行切成若干字节区间：先并行统计各区间的记录数，
+    /// 由前缀和得到各区间在数据集中的起始行，再并行解析到各自的位置，记录保持文件中的次序
+    /// @tparam __T 数据类型
+    /// @tparam __ST 标签类型
+    /// @param __filename 文件名
+    /// @param __ds_ref 数据集的引用
+    /// @param __line_func_obj 提供分隔符与维度的默认行读取对象
+    /// @param __skipped 跳过开头的行数
+    /// @param thread_cnt 线程数，若为非正数，则不使用多线程
+    void readDatasetFile(const char* __filename, DefaultDataSet<__T, __ST>& __ds_ref,
+                        const DefaultReadLine<__T, __ST>& __line_func_obj, int __skipped = 0,
+                        int thread_cnt = -1) {
+        const char sep = __line_func_obj.separator();
+        const long long dimension = __line_func_obj.getDimension();
+        // 两条路径都按读取对象的维度写入特征缓冲区，因此在追加任何行之前统一一次维度。
+        // 不一致时先解析到读取对象宽度的临时行，再由`appendRecord`补齐或截断，此时只串行读取
+        const bool direct = __ds_ref.adoptDimension(dimension);
+        auto file = MappedFile::open(__filename);
+        if (file == nullptr || thread_cnt <= 1 || !direct) {
+            file.reset();
+            std::vector<__T> scratch(direct ? 0 : dimension);
+            // 不预留空间：首行长度不能代表全部行，特征缓冲区按几何方式增长
+            scanLines(__filename, [&](const char* __begin, const char* __end) {
+                if (__skipped) {
+                    --__skipped;
+                    return;
+                }
+                if (!trimLine(__begin, __end)) return;
+                __ST label{};
+                if (!direct) {
+                    std::fill(scratch.begin(), scratch.end(), __T{});
+                    parseCsvLine(__begin, __end, sep, dimension, scratch.data(), label);
+                    __ds_ref.appendRecord(scratch, label);
+                    return;
+                }
+                __T* row = __ds_ref.emplaceRow();
+                parseCsvLine(__begin, __end, sep, dimension, row, label);
+                __ds_ref.setLabel(__ds_ref.dataSize() - 1, std::move(label));
+            });
+            return;
+        }
+
+        const char* begin = file->data();
+        const char* end = begin + file->size();
+        for (; __skipped > 0 && begin < end; --__skipped) {
+            auto nl = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            begin = (nl == nullptr) ? end : nl + 1;
+        }
+        // 每个区间至少1MiB，区间数多于线程数以平衡各区间的耗时
+        constexpr long long min_chunk = 1LL << 20;
+        const long long bytes = end - begin;
+        const long long chunk_cnt = std::max(1LL, std::min<long long>(4LL * thread_cnt, bytes / min_chunk));
+        std::vector<const char*> bounds{begin};
+        for (long long c = 1; c < chunk_cnt; ++c) {
+            const char* cut = std::max(bounds.back(), begin + bytes * c / chunk_cnt);
+            auto nl = static_cast<const char*>(std::memchr(cut, '\n', end - cut));
+            bounds.push_back((nl == nullptr) ? end : nl + 1);
+        }
+        bounds.push_back(end);
+
+        auto for_lines = [](const char* __cur, const char* __stop, auto&& __func) {
+            while (__cur < __stop) {
+                auto nl = static_cast<const char*>(std::memchr(__cur, '\n', __stop - __cur));
+                const char* line_end = (nl == nullptr) ? __stop : nl;
+                if (trimLine(__cur, line_end)) __func(__cur, line_end);
+                __cur = (nl == nullptr) ? __stop : nl + 1;
+            }
+        };
+        ThreadPool& pool = ThreadPool::global();
+        auto run_chunks = [&](auto&& __task) {
+            std::vector<std::future<void>> rets;
+            rets.reserve(chunk_cnt);
+            for (long long c = 0; c < chunk_cnt; ++c) {
+                rets.push_back(pool.submit([&__task, c]() { __task(c); }));
+            }
+            for (auto& ret : rets) pool.wait(ret);
+        };
+
+        std::vector<long long> first_row(chunk_cnt + 1, 0);
+        run_chunks([&](long long c) {
+            long long cnt = 0;
+            for_lines(bounds[c], bounds[c + 1], [&cnt](const char*, const char*) { ++cnt; });
+            first_row[c + 1] = cnt;
+        });
+        for (long long c = 0; c < chunk_cnt; ++c) first_row[c + 1] += first_row[c];
+        const long long base_row = __ds_ref.dataSize();
+        __T* rows = __ds_ref.emplaceRows(first_row.back());
+        // 各块先以局部的标签表编号，再按块的次序并入数据集的标签表，编号仍按标签在文件中首次出现的次序分配
+        std::vector<LabelTable<__ST>> local_tables(chunk_cnt);
+        std::vector<std::uint32_t> local_ids(first_row.back());
+        run_chunks([&](long long c) {
+            long long index = first_row[c];
+            for_lines(bounds[c], bounds[c + 1], [&](const char* __begin, const char* __end) {
+                __ST label{};
+                parseCsvLine(__begin, __end, sep, dimension, rows + index * dimension, label);
+                local_ids[index] = local_tables[c].intern(label);
+                ++index;
+            });
+        });
+        std::vector<std::vector<std::uint32_t>> remap(chunk_cnt);
+        for (long long c = 0; c < chunk_cnt; ++c) {
+            remap[c].resize(local_tables[c].size());
+            for (std::size_t l = 0; l < remap[c].size(); ++l) {
+                remap[c][l] = __ds_ref.internLabel(local_tables[c].at(static_cast<std::uint32_t>(l)));
+            }
+        }
+        run_chunks([&](long long c) {
+            for (long long index = first_row[c]; index < first_row[c + 1]; ++index) {
+                __ds_ref.setLabelId(base_row + index, remap[c][local_ids[index]]);
+            }
+        });
+    }
+
+    /// @brief 对近邻的标签计票。标签已编号时以编号为下标直接定位计数，不再哈希标签；未编号时按值线性查找。
+    ///        票数相同时先达到该票数的标签胜出，即更近的近邻优先
+    /// @tparam __ST 标签类型
+    template<class __ST>
+    class VoteCounter {
+        public:
+        /// @brief 清空票数，只重置上一轮出现过的标签
+        void reset() {
+            for (const Entry& e : entries) {
+                if (e.label != no_label_id) slot[e.label] = -1;
+            }
+            entries.clear();
+            best = -1;
+        }
+        /// @brief 加入一票
+        /// @param __label 标签编号，可为`no_label_id`
+        /// @param __state 标签，须在计票期间保持有效
+        void add(std::uint32_t __label, const __ST* __state) {
+            int at = -1;
+            if (__label != no_label_id) {
+                if (__label >= slot.size()) slot.resize(static_cast<std::size_t>(__label) + 1, -1);
+                at = slot[__label];
+                if (at < 0) slot[__label] = at = static_cast<int>(entries.size());
+            } else {
+                for (std::size_t i = 0; i < entries.size(); ++i) {
+                    if (*entries[i].state == *__state) {
+                        at = static_cast<int>(i);
+                        break;
+                    }
+                }
+                if (at < 0) at = static_cast<int>(entries.size());
+            }
+            if (at == static_cast<int>(entries.size())) entries.push_back(Entry{__label, __state, 0});
+            const int cnt = ++entries[at].count;
+            if (best < 0 || cnt > entries[best].count) best = at;
+        }
+        /// @brief 当前得票最多的标签，尚无投票时为`nullptr`
+        inline const __ST* winner() const { return (best < 0) ? nullptr : entries[best].state; }
+        /// @brief 当前得票最多的标签的编号
+        inline std::uint32_t winnerLabel() const { return (best < 0) ? no_label_id : entries[best].label; }
+        /// @brief 按首次得票的次序遍历各标签及其票数
+        template<class __F>
+        void forEach(__F&& __func) const {
+            for (const Entry& e : entries) __func(*e.state, e.count);
+        }
+
+        private:
+        struct Entry {
+            std::uint32_t label;
+            const __ST* state;
+            int count;
+        };
+        /// @brief 以标签编号为下标，值为在`entries`中的位置，-1表示本轮未出现
+        std::vector<int> slot;
+        std::vector<Entry> entries;
+        int best = -1;
+    };
+
     template<class __T, class __ST>
     /// @brief 格式化打印结果，包括选取的数据信息以及标签的数量统计
     /// @tparam __T 向量数据类型
     /// @tparam __ST 标签数据类型
     /// @param __ret_vec 任意KNN对象的`get`方法返回的记录指针数组
     /// @param __detail_display 是否打印详细信息
-    void collectResult(const std::vector<const Record<__T, __ST>*>& __ret_vec, 
+    void collectResult(const std::vector<RecordView<__T, __ST>>& __ret_vec, 
                        bool __detail_display = true) {
         if (__detail_display) {
             std::cout << "----------------------------" << '\n';
             std::cout << "According to ascending order:\n";
         }
-        std::unordered_map<__ST, int> collect;
-        const Record<__T, __ST>* __rec;
-        for (int i = 0; i < __ret_vec.size(); ++i) {
-            __rec = __ret_vec.at(i);
+        VoteCounter<__ST> collect;
+        for (std::size_t i = 0; i < __ret_vec.size(); ++i) {
+            const RecordView<__T, __ST>& __rec = __ret_vec[i];
             if (__detail_display) {
                 std::cout << std::left;
-                for (int j = 0; j < __rec->vec.size(); ++j) {
-                    std::cout << std::setw(10) << __rec->vec[j];
+                // 不含原始向量的索引(如脱离数据集的`IVFPQ`)只给出下标
+                if (__rec.vec == nullptr) std::cout << '#' << std::setw(9) << __rec.index;
+                for (int j = 0; __rec.vec != nullptr && j < __rec.dimension; ++j) {
+                    std::cout << std::setw(10) << +__rec.vec[j];
                 }
-                std::cout << "  ->  " << __rec->state << '\n';
+                std::cout << "  ->  " << *__rec.state << '\n';
                 std::cout.unsetf(std::ios::left);
             }
-            auto it = collect.find(__rec->state);
-            if (it != collect.end()) {
-                it->second += 1;
-            } else {
-                collect[__rec->state] = 1;
-            }
+            collect.add(__rec.label, __rec.state);
         }
         std::cout << "----------------------------" << '\n';
         std::cout << "Summary:" << '\n';
         std::cout << "Label : Frequency | Percentage" << '\n';
         std::cout << std::left;
-        for (auto it = collect.begin(); it != collect.end(); ++it) {
-            std::cout << std::setw(5) << it->first << " : " 
-                    << std::setw(9) << it->second << " | "
-                    << (static_cast<double>(it->second) / __ret_vec.size()) << '\n';
-        }
+        collect.forEach([&__ret_vec](const __ST& __label, int __cnt) {
+            std::cout << std::setw(5) << __label << " : " 
+                    << std::setw(9) << __cnt << " | "
+                    << (static_cast<double>(__cnt) / __ret_vec.size()) << '\n';
+        });
         std::cout.unsetf(std::ios::left);
         std::cout << "----------------------------" << '\n';
         std::flush(std::cout);
     }
 
     template<class __T, class __ST>
-    /// @brief 由指定数据集创建训练集和测试集
+    /// @brief 随机选取测试集的记录下标，训练集的下标保持原有顺序
+    /// @return `__test_size`超出范围时返回`false`
+    bool splitTestIndices(const DataSet<__T, __ST>& __source, long long __test_size,
+                          std::vector<long long>& __training_indices, std::vector<long long>& __test_indices) {
+        const long long tot = __source.dataSize();
+        if (__test_size < 0 || __test_size > tot) return false;
+
+        std::random_device r;
+        std::default_random_engine rand_engine(r());
+        std::vector<long long> order(tot);
+        for (long long i = 0; i < tot; ++i) order[i] = i;
+        // 只打乱前`__test_size`个位置
+        for (long long i = 0; i < __test_size; ++i) {
+            std::uniform_int_distribution<long long> distribute(i, tot - 1);
+            std::swap(order[i], order[distribute(rand_engine)]);
+        }
+        std::vector<char> chosen(tot, 0);
+        __test_indices.assign(order.begin(), order.begin() + __test_size);
+        for (long long x : __test_indices) chosen[x] = 1;
+        __training_indices.clear();
+        __training_indices.reserve(tot - __test_size);
+        for (long long i = 0; i < tot; ++i) {
+            if (!chosen[i]) __training_indices.push_back(i);
+        }
+        return true;
+    }
+
+    template<class __T, class __ST>
+    /// @brief 由指定数据集创建训练集和测试集，记录被复制到给定的数据集中
     /// @tparam __T 数据类型
     /// @tparam __ST 标签类型
     /// @param __source 源数据集
@@ -914,30 +4829,89 @@ namespace knn {
     /// @param __test_size 测试集大小
     void selectTestGroup(const DataSet<__T, __ST>& __source, DataSet<__T, __ST>& __training_group, 
                          DataSet<__T, __ST>& __test_group, long long __test_size) {
-        if (__test_size < 0) return ;
-        if (__test_size > __source.dataSize()) return;
+        std::vector<long long> training_indices, test_indices;
+        if (!splitTestIndices(__source, __test_size, training_indices, test_indices)) return;
+        for (long long x : test_indices) __test_group.appendRecord(__source.getRef(x));
+        for (long long x : training_indices) __training_group.appendRecord(__source.getRef(x));
+    }
 
-        std::set<long long> check_map;
-        std::random_device r;
-        std::default_random_engine rand_engine(r());
-        std::uniform_int_distribution<long long> distribute(0, __source.dataSize() - 1);
-        
-        long long x;
-        while (__test_size) {
-            x = distribute(rand_engine);
-            if (check_map.find(x) == check_map.end()) {
-                check_map.insert(x);
-                __test_group.appendRecord(*(__source.getRef(x)));
-                --__test_size;
+    template<class __T, class __ST>
+    /// @brief 由指定数据集创建训练集和测试集，两者均为引用源数据集的视图，不复制记录
+    /// @tparam __T 数据类型
+    /// @tparam __ST 标签类型
+    /// @param __source 源数据集
+    /// @param __training_group 训练集视图，原有内容被替换
+    /// @param __test_group 测试集视图，原有内容被替换
+    /// @param __test_size 测试集大小
+    void selectTestGroup(const DataSet<__T, __ST>& __source, DataSetView<__T, __ST>& __training_group,
+                         DataSetView<__T, __ST>& __test_group, long long __test_size) {
+        std::vector<long long> training_indices, test_indices;
+        if (!splitTestIndices(__source, __test_size, training_indices, test_indices)) return;
+        __test_group = DataSetView<__T, __ST>(__source, std::move(test_indices));
+        __training_group = DataSetView<__T, __ST>(__source, std::move(training_indices));
+    }
+    
+    template<class __T, class __DT, class __ST>
+    /// @brief 检查k取`[__lower, __upper]`内各值并固定测试集时预测的正确率。
+    ///        每个测试点只查询一次`__upper`个近邻，按距离依次加入投票，前k个近邻的投票结果即为k对应的预测
+    /// @tparam __T 数据类型
+    /// @tparam __DT 距离类型
+    /// @tparam __ST 标签类型
+    /// @param __knn `BaseKNN`对象
+    /// @param __lower k的下界
+    /// @param __upper k的上界
+    /// @param __test_set 测试集
+    /// @param thread_cnt 多线程查询线程数，若为非正数，则不使用多线程
+    /// @return 第i个元素为k取`__lower + i`时的正确率
+    std::vector<double> testCorrectnessRange(BaseKNN<__T, __DT, __ST>& __knn, int __lower, int __upper,
+                                             const DataSet<__T, __ST>& __test_set, int thread_cnt = -1) {
+        if (__lower > __upper) std::swap(__lower, __upper);
+        const int k_cnt = __upper - __lower + 1;
+        std::vector<long long> correct(k_cnt, 0);
+        VoteCounter<__ST> votes;
+        // 训练集对标签编号时，以编号比较预测与真实标签
+        const DataSet<__T, __ST>* train_set = __knn.getDatasetRef();
+        const bool by_id = (train_set != nullptr && train_set->labelCount() > 0);
+        std::vector<std::vector<__T>> queries;
+        std::vector<std::vector<RecordView<__T, __ST>>> batch_results;
+        // 按块批量查询，多线程时块内查询分配至线程池
+        const long long batch_size = 1024;
+
+        for (long long i = 0; i < __test_set.dataSize(); ++i) {
+            if (i % batch_size == 0) {
+                long long batch_end = std::min(__test_set.dataSize(), i + batch_size);
+                queries.resize(batch_end - i);
+                for (long long j = i; j < batch_end; ++j) {
+                    RecordView<__T, __ST> view = __test_set.getRef(j);
+                    queries[j - i].assign(view.vec, view.vec + view.dimension);
+                }
+                __knn.getBatch(queries, __upper, batch_results, thread_cnt);
             }
-        }
-        for (long long i = 0; i < __source.dataSize(); ++i) {
-            if (check_map.find(i) == check_map.end()) {
-                __training_group.appendRecord(*(__source.getRef(i)));
+            const __ST& truth = *__test_set.getRef(i).state;
+            const std::vector<RecordView<__T, __ST>>& results = batch_results[i % batch_size];
+            const int found = static_cast<int>(std::min<std::size_t>(results.size(), __upper));
+            const std::uint32_t truth_id = by_id ? train_set->findLabel(truth) : no_label_id;
+            votes.reset();
+            bool hit = false;
+            for (int j = 0; j < found; ++j) {
+                votes.add(results[j].label, results[j].state);
+                hit = by_id ? (truth_id != no_label_id && votes.winnerLabel() == truth_id)
+                            : (*votes.winner() == truth);
+                if (j + 1 >= __lower && hit) correct[j + 1 - __lower] += 1;
+            }
+            // 结果不足k个时沿用全部结果的投票
+            if (hit) {
+                for (int k = std::max(found + 1, __lower); k <= __upper; ++k) correct[k - __lower] += 1;
             }
         }
+        std::vector<double> ret(k_cnt, 0.0);
+        if (__test_set.dataSize() <= 0) return ret;
+        for (int i = 0; i < k_cnt; ++i) {
+            ret[i] = static_cast<double>(correct[i]) / __test_set.dataSize();
+        }
+        return ret;
     }
-    
+
     template<class __T, class __DT, class __ST>
     /// @brief 检查k取特定值并固定测试集时预测的正确率
     /// @tparam __T 数据类型
@@ -950,71 +4924,99 @@ namespace knn {
     /// @return 正确率
     double testCorrectness(BaseKNN<__T, __DT, __ST>& __knn, int __test_k,
                          const DataSet<__T, __ST>& __test_set, int thread_cnt = -1) {
-        long long correct = 0;
-        std::vector<const Record<__T, __ST>*> results;
-        std::unordered_map<__ST, int> collect;
-        
-        for (int i = 0; i < __test_set.dataSize(); ++i) {
-            results.clear();  collect.clear();
-            const Record<__T, __ST>* ptr = __test_set.getRef(i);
-            if (thread_cnt <= 0) __knn.get(ptr->vec, __test_k, results);
-            else __knn.multiThreadGet(ptr->vec, __test_k, thread_cnt, results);
-            for (auto it = results.begin(); it != results.end(); ++it) {
-                auto mit = collect.find((*it)->state);
-                if (mit == collect.end()) collect[(*it)->state] = 1;
-                else mit->second += 1;
-            }
-            int __max = INT_MIN; __ST label;
-            for (auto it = collect.begin(); it != collect.end(); ++it) {
-                if (it->second > __max) {
-                    __max = it->second;
-                    label = it->first;
-                }
-            }
-            correct += (label == ptr->state) ? 1 : 0;
-        }
-        return static_cast<double>(correct) / __test_set.dataSize();
+        std::vector<double> ret = testCorrectnessRange(__knn, __test_k, __test_k, __test_set, thread_cnt);
+        return ret.empty() ? 0.0 : ret[0];
     }
 
     template<class __T, class __ST, class __KNN>
-    double crossValidation(const DataSet<__T, __ST>& __dataset, int __k, int __group_cnt) {
-        if (__group_cnt < 1) return 0.0;
-        int tot_size = __dataset.dataSize();
-        int dimension = __dataset.getDimension();
-        int group_unit = tot_size / __group_cnt;
-        int final_group = group_unit + (tot_size % __group_cnt);
-        std::vector<const Record<__T, __ST>*> all_data;
-        all_data.reserve(tot_size);
-        for (int i = 0; i < tot_size; ++i) {
-            all_data.push_back(__dataset.getRef(i));
+    /// @brief 交叉验证中的一折，作为独立的任务执行。
+    ///        划分由`__seed`确定，同一次交叉验证的各折以相同的种子重新生成相同的划分，任务之间不共享状态
+    /// @param __fold 作为测试集的组号
+    /// @param thread_cnt 折内查询的线程数，若为非正数，则不使用多线程
+    /// @return 第i个元素为k取`__lower + i`时该折的正确率
+    std::vector<double> __cv_fold_task(const DataSet<__T, __ST>& __dataset, unsigned __seed, int __fold,
+                                       int __group_cnt, int __lower, int __upper, int thread_cnt) {
+        const long long tot_size = __dataset.dataSize();
+        const long long group_unit = tot_size / __group_cnt;
+        std::vector<long long> all_data(tot_size);
+        for (long long i = 0; i < tot_size; ++i) {
+            all_data[i] = i;
         }
-        std::random_device rd;
-        std::default_random_engine gen_rand(rd());
+        std::default_random_engine gen_rand(__seed);
         std::shuffle(all_data.begin(), all_data.end(), gen_rand);
-        std::vector<std::pair<int, int>> group_ranges;
-        group_ranges.reserve(__group_cnt);
-        for (int i = 0; i < __group_cnt - 1; ++i) {
-            group_ranges.push_back(std::make_pair(i * group_unit, (i + 1) * group_unit));
-        }
-        group_ranges.push_back(std::make_pair(tot_size - final_group, tot_size));
-        
-        // Start cv
-        double acc_sum = 0.0;
-        for (int i = 0; i < __group_cnt; ++i) {
-            int group_size = group_ranges[i].second - group_ranges[i].first;
-            DefaultDataSet<__T, __ST> train_set(dimension, tot_size - group_size), 
-                                      test_set(dimension, group_size);
-            for (int j = 0; j < tot_size; ++j) {
-                if (j >= group_ranges[i].first && j < group_ranges[i].second) {
-                    test_set.appendRecord(*all_data[j]);
-                } else {
-                    train_set.appendRecord(*all_data[j]);
+        // 最后一组包含余下的记录
+        const long long first = __fold * group_unit;
+        const long long last = (__fold == __group_cnt - 1) ? tot_size : first + group_unit;
+
+        // 训练集与测试集均为引用原数据集的视图
+        DataSetView<__T, __ST> test_set(__dataset, all_data, first, last);
+        std::vector<long long> train_indices;
+        train_indices.reserve(tot_size - (last - first));
+        train_indices.insert(train_indices.end(), all_data.begin(), all_data.begin() + first);
+        train_indices.insert(train_indices.end(), all_data.begin() + last, all_data.end());
+        DataSetView<__T, __ST> train_set(__dataset, std::move(train_indices));
+        __KNN __knn_obj(train_set);
+        return testCorrectnessRange(__knn_obj, __lower, __upper, test_set, thread_cnt);
+    }
+
+    template<class __T, class __ST, class __KNN>
+    /// @brief 将`__seeds.size()`次交叉验证的每一折作为任务提交至全局线程池，返回k取`[__lower, __upper]`内各值时
+    ///        所有折的正确率之和。线程池按工作窃取分配任务，每个任务的查询再分块并行，折数少于线程数时仍能占满线程
+    /// @param thread_cnt 线程数，若不大于1，则在当前线程上依次执行
+    std::vector<double> __cv_schedule(const DataSet<__T, __ST>& __dataset, const std::vector<unsigned>& __seeds,
+                                      int __group_cnt, int __lower, int __upper, int thread_cnt) {
+        std::vector<double> acc_sum(__upper - __lower + 1, 0.0);
+        if (thread_cnt <= 1) {
+            for (unsigned seed : __seeds) {
+                for (int fold = 0; fold < __group_cnt; ++fold) {
+                    std::vector<double> acc = __cv_fold_task<__T, __ST, __KNN>(
+                        __dataset, seed, fold, __group_cnt, __lower, __upper, -1);
+                    for (std::size_t j = 0; j < acc.size(); ++j) acc_sum[j] += acc[j];
                 }
             }
-            __KNN __knn_obj(train_set);
-            acc_sum += testCorrectness(__knn_obj, __k, test_set);
+            return acc_sum;
+        }
+        ThreadPool& pool = ThreadPool::global();
+        std::vector<std::future<std::vector<double>>> rets;
+        rets.reserve(__seeds.size() * __group_cnt);
+        for (unsigned seed : __seeds) {
+            for (int fold = 0; fold < __group_cnt; ++fold) {
+                rets.push_back(pool.submit([&__dataset, seed, fold, __group_cnt, __lower, __upper, thread_cnt]() {
+                    return __cv_fold_task<__T, __ST, __KNN>(__dataset, seed, fold, __group_cnt,
+                                                            __lower, __upper, thread_cnt);
+                }));
+            }
+        }
+        for (auto& ret : rets) {
+            std::vector<double> acc = pool.wait(ret);
+            for (std::size_t j = 0; j < acc.size(); ++j) acc_sum[j] += acc[j];
         }
-        return acc_sum / static_cast<double>(__group_cnt);
+        return acc_sum;
+    }
+
+    template<class __T, class __ST, class __KNN>
+    /// @brief 以一次随机划分进行交叉验证，返回k取`[__lower, __upper]`内各值时的平均正确率。
+    ///        每一折只构建一次KNN对象，每个测试点只查询一次
+    /// @param thread_cnt 线程数，若为非正数，则不使用多线程；否则各折并行
+    /// @return 第i个元素为k取`__lower + i`时的正确率
+    std::vector<double> crossValidationRange(const DataSet<__T, __ST>& __dataset, int __lower, int __upper,
+                                             int __group_cnt, int thread_cnt = -1) {
+        if (__lower > __upper) std::swap(__lower, __upper);
+        if (__group_cnt < 1) return std::vector<double>(__upper - __lower + 1, 0.0);
+        std::random_device rd;
+        std::vector<double> acc_sum = __cv_schedule<__T, __ST, __KNN>(
+            __dataset, std::vector<unsigned>{rd()}, __group_cnt, __lower, __upper, thread_cnt);
+        for (auto& acc : acc_sum) acc /= static_cast<double>(__group_cnt);
+        return acc_sum;
+    }
+
+    template<class __T, class __ST, class __KNN>
+    /// @brief 交叉验证k取特定值时的平均正确率
+    /// @param thread_cnt 线程数，若为非正数，则不使用多线程；否则各折并行
+    double crossValidation(const DataSet<__T, __ST>& __dataset, int __k, int __group_cnt, int thread_cnt = -1) {
+        if (__group_cnt < 1) return 0.0;
+        std::vector<double> ret = crossValidationRange<__T, __ST, __KNN>(__dataset, __k, __k, __group_cnt, thread_cnt);
+        return ret.empty() ? 0.0 : ret[0];
     }
 
     template<class __T, class __ST, class __KNN>
@@ -1026,58 +5028,25 @@ namespace knn {
     /// @param iteration_cnt 重复次数
     /// @param __k_range 表示k范围的std::pair
     /// @param __group_count 交叉验证组数
-    /// @param __container 结果容器，类型为`knn_k_optimization_ret_list`
+    /// @param __container 结果容器，类型为`knn_k_optimization_ret_list`，按k升序排列
     void kRangedCheck(const DataSet<__T, __ST>& data_set, int iteration_cnt,
                    std::pair<int, int> __k_range, int __group_count,
                    knn_ranged_k_ret_list& __container) {
-        int __lower = __k_range.first;
-        int __upper = __k_range.second;
-        if (__lower > __upper) std::swap(__lower, __upper);
-        __container.clear();
-        std::unordered_map<int, double> k_map;
-
-        for (int iter = 0; iter < iteration_cnt; ++iter) {
-            for (int k = __lower; k <= __upper; ++k) {
-                double c = crossValidation<__T, __ST, __KNN>(data_set, k, __group_count);
-                auto it = k_map.find(k);
-                if (it == k_map.end()) k_map.insert(std::make_pair(k, c));
-                else it->second += c;
-            }
-        }
-
-        for (auto it = k_map.begin(); it != k_map.end(); ++it) {
-            it->second /= static_cast<double>(iteration_cnt);
-            __container.push_back(*it);
-        }
+        kRangedCheck<__T, __ST, __KNN>(data_set, iteration_cnt, -1, __k_range, __group_count, __container);
     }
 
     template<class __T, class __ST, class __KNN>
-    void __optimize_sub_task(const DataSet<__T, __ST>* __ds, int iter, int __lk, int __uk,
-                             int __cv, std::promise<std::unordered_map<int, double>*> __p) {
-        auto map_ptr = new std::unordered_map<int, double>();
-
-        for (int i = 0; i < iter; ++i) {
-            for (int k = __lk; k <= __uk; ++k) {
-                double c = crossValidation<__T, __ST, __KNN>(*__ds, k, __cv);
-                auto it = map_ptr->find(k);
-                if (it == map_ptr->end()) map_ptr->insert(std::make_pair(k, c));
-                else it->second += c;
-            }
-        }
-        __p.set_value(map_ptr);
-    }
-
-    template<class __T, class __ST, class __KNN>
-    /// @brief 获取范围内K的准确度（多线程加速重载）
+    /// @brief 获取范围内K的准确度（多线程加速重载，任务提交至全局线程池）
+    ///        每次重复的每一折为一个任务，折内的查询再分块并行，重复次数少于线程数时同样并行
     /// @tparam __T 数据类型
     /// @tparam __ST 标签类型
     /// @tparam __KNN KNN类型
     /// @param __data_set 数据集
     /// @param iteration_cnt 重复次数
-    /// @param thread_cnt 线程数
+    /// @param thread_cnt 线程数，若不大于1，则不使用多线程
     /// @param __k_range 表示k范围的std::pair
     /// @param __group_count 交叉验证组数
-    /// @param __container 结果容器，类型为`knn_k_optimization_ret_list`
+    /// @param __container 结果容器，类型为`knn_k_optimization_ret_list`，按k升序排列
     void kRangedCheck(const DataSet<__T, __ST>& data_set, int iteration_cnt, int thread_cnt,
                        std::pair<int, int> __k_range, int __group_count,
                        knn_ranged_k_ret_list& __container) {
@@ -1085,48 +5054,16 @@ namespace knn {
         int __upper = __k_range.second;
         if (__lower > __upper) std::swap(__lower, __upper);
         __container.clear();
-        std::unordered_map<int, double> tot_k_map;
-        std::vector<std::thread*> thread_pool;
-        std::vector<std::future<std::unordered_map<int, double>*>> thread_rets;
-        thread_pool.reserve(thread_cnt);
-        thread_rets.reserve(thread_cnt);
-
-        if (iteration_cnt < thread_cnt) {
-            kRangedCheck<__T, __ST, __KNN>(data_set, iteration_cnt, {__lower, 
-                                           __upper}, __group_count, __container);
-            return ;
-        }
-
-        int left = 0, right = 0, cnt = 0;
-        int iteration_unit = iteration_cnt / thread_cnt;
-        int final_unit = iteration_cnt - (iteration_unit * thread_cnt);
-        for (int it = 0; it < thread_cnt; ++it) {
-            if (it == thread_cnt - 1) cnt = final_unit + iteration_unit;
-            else cnt = iteration_unit;
-            std::promise<std::unordered_map<int, double>*> __pro;
-            thread_rets.push_back(__pro.get_future());
-            auto t_ptr = new std::thread(__optimize_sub_task<__T, __ST, __KNN>, 
-                                         &data_set, cnt, __lower, __upper, __group_count, std::move(__pro));
-            thread_pool.push_back(t_ptr);
-        }
-
-        for (int it = 0; it < thread_cnt; ++it) {
-            auto t_ptr = thread_pool.at(it);
-            t_ptr->join();
-            std::unordered_map<int, double>* map_ptr = thread_rets[it].get();
-            for (auto it = map_ptr->begin(); it != map_ptr->end(); ++it) {
-                auto tot_it = tot_k_map.find(it->first);
-                if (tot_it == tot_k_map.end()) tot_k_map.insert(*it);
-                else tot_it->second += it->second;
-            }
-            delete t_ptr;
-            delete map_ptr;
-            thread_pool[it] = nullptr;
-        }
-
-        for (auto it = tot_k_map.begin(); it != tot_k_map.end(); ++it) {
-            it->second /= static_cast<double>(iteration_cnt);
-            __container.push_back(*it);
+        if (iteration_cnt <= 0 || __group_count < 1) return;
+
+        std::random_device rd;
+        std::vector<unsigned> seeds(iteration_cnt);
+        for (auto& seed : seeds) seed = rd();
+        std::vector<double> acc_sum = __cv_schedule<__T, __ST, __KNN>(
+            data_set, seeds, __group_count, __lower, __upper, thread_cnt);
+        const double tot_folds = static_cast<double>(iteration_cnt) * __group_count;
+        for (int k = __lower; k <= __upper; ++k) {
+            __container.push_back(std::make_pair(k, acc_sum[k - __lower] / tot_folds));
         }
     }
 
@@ -8,12 +8,28 @@
 
 using namespace knn;
 
+// 交互环境只需要近邻的次序，使用平方欧氏距离省去开方
+typedef Brute<double, double, std::string, SquaredEuclidean> brute_type;
+typedef KDTree<double, double, std::string, SquaredEuclidean> kd_tree_type;
+// VP树依赖三角不等式剪枝，需使用欧氏距离本身
+typedef VPTree<double, double, std::string, Euclidean> vp_tree_type;
+typedef HNSW<double, double, std::string, SquaredEuclidean> hnsw_type;
+typedef IVFPQ<double, double, std::string, SquaredEuclidean> ivfpq_type;
+typedef LSH<double, double, std::string, Euclidean> lsh_type;
+// float与int8储存的数据集只提供精确查询，距离以double累加
+template<class __T> using compact_brute_type = Brute<__T, double, std::string, SquaredEuclidean>;
+template<class __T> using compact_kd_tree_type = KDTree<__T, double, std::string, SquaredEuclidean>;
+
 int executed_cnt = 0;
 int global_thread_cnt, global_max_line, global_diag_height;
 bool global_detail_print, global_range_diag;
 std::string global_allow_start, global_start_path;
 std::unordered_map<std::string, std::pair<knn::BaseKNN<double, double, std::string>*, int>> knn_storage;
 std::unordered_map<std::string, knn::DefaultDataSet<double, std::string>*> dataset_storage;
+template<class __T>
+std::unordered_map<std::string, std::pair<knn::BaseKNN<__T, double, std::string>*, int>> compact_knn_storage;
+template<class __T>
+std::unordered_map<std::string, knn::DefaultDataSet<__T, std::string>*> compact_dataset_storage;
 std::unordered_map<std::string, int> k_val_storage;
 std::set<std::string> variable_table;
 std::string run_id;
@@ -39,10 +55,7 @@ void binaryWrite(const __WT& __data, std::ofstream& __ofs) {
 }
 template<class __RT>
 void binaryRead(__RT& __val, std::ifstream& __ifs) {
-    char* x = new char[sizeof(__RT)];
-    __ifs.read(x, sizeof(__RT));
-    __val = *reinterpret_cast<__RT*>(x);
-    delete[] x;
+    __ifs.read(reinterpret_cast<char*>(&__val), sizeof(__RT));
 }
 
 void generateRunId() {
@@ -68,21 +81,191 @@ std::vector<std::string> readCommandFile(const std::string& __source) {
     return cmd_lines;
 }
 
+template<class __T>
 bool operateDataset(const std::vector<std::string>& __args,
-                    DefaultDataSet<double, std::string>* __target) {
-    if (__args[1] == "z-score") {
-        std::cout << "Perform z-score normalization on " << __args[0] << '\n';
-        __target->zScoreNormalization();
+                    DefaultDataSet<__T, std::string>* __target) {
+    // int8储存的量化参数在转换时已确定，不再标准化
+    if constexpr (storage_type_of<__T> == StorageType::Int8) {
+        return false;
+    } else {
+        Scaling method;
+        if (__args[1] == "z-score") method = Scaling::ZScore;
+        else if (__args[1] == "min-max") method = Scaling::MinMax;
+        else if (__args[1] == "robust") method = Scaling::Robust;
+        else return false;
+        std::cout << "Perform " << __args[1] << " normalization on " << __args[0] << '\n';
+        __target->normalize(method, global_thread_cnt);
         return true;
     }
-    return false;
 }
 
 bool operateKNN(const std::vector<std::string>& __args,
                 int knn_type, BaseKNN<double, double, std::string>* __target) {
+    if (knn_type == 3 && __args[1] == "ef" && __args.size() >= 3) {
+        int ef; fromStr(__args[2], ef);
+        auto hnsw_ptr = dynamic_cast<hnsw_type*>(__target);
+        hnsw_ptr->setEfSearch(ef);
+        std::cout << "Set efSearch of " << __args[0] << " to " << hnsw_ptr->getParam().ef_search << '\n';
+        return true;
+    }
+    if (knn_type == 4 && (__args[1] == "nprobe" || __args[1] == "rerank") && __args.size() >= 3) {
+        int value; fromStr(__args[2], value);
+        auto ivfpq_ptr = dynamic_cast<ivfpq_type*>(__target);
+        if (__args[1] == "nprobe") ivfpq_ptr->setNprobe(value);
+        else ivfpq_ptr->setRerank(value);
+        std::cout << "Set nprobe=" << ivfpq_ptr->getParam().nprobe << ", rerank="
+                << ivfpq_ptr->getParam().rerank << " of " << __args[0] << '\n';
+        return true;
+    }
+    if (knn_type == 5 && __args[1] == "probes" && __args.size() >= 3) {
+        int probes; fromStr(__args[2], probes);
+        auto lsh_ptr = dynamic_cast<lsh_type*>(__target);
+        lsh_ptr->setProbes(probes);
+        std::cout << "Set probes of " << __args[0] << " to " << lsh_ptr->getParam().probes << '\n';
+        return true;
+    }
     return false;
 }
 
+/// @brief 映射模型文件中的数据集，其后的索引结构仍从流中读取
+template<class __T>
+void mapDataset(DefaultDataSet<__T, std::string>* __target, const std::string& __path, std::ifstream& __file) {
+    long long end = __target->loadFromBin(__path.c_str(), static_cast<long long>(__file.tellg()));
+    if (end >= 0) __file.seekg(end);
+    else __file.setstate(std::ios::failbit);
+}
+
+inline const char* storageName(StorageType __storage) {
+    if (__storage == StorageType::Float32) return "float32";
+    if (__storage == StorageType::Int8) return "int8";
+    return "float64";
+}
+
+inline bool parseStorage(const std::string& __name, StorageType& __storage) {
+    if (__name == "float64") __storage = StorageType::Float64;
+    else if (__name == "float32") __storage = StorageType::Float32;
+    else if (__name == "int8") __storage = StorageType::Int8;
+    else return false;
+    return true;
+}
+
+// 按储存类型查找数据集与KNN对象
+inline bool findDataset(const std::string& __name, StorageType& __storage) {
+    if (dataset_storage.count(__name)) __storage = StorageType::Float64;
+    else if (compact_dataset_storage<float>.count(__name)) __storage = StorageType::Float32;
+    else if (compact_dataset_storage<std::int8_t>.count(__name)) __storage = StorageType::Int8;
+    else return false;
+    return true;
+}
+
+inline bool findKNN(const std::string& __name, StorageType& __storage) {
+    if (knn_storage.count(__name)) __storage = StorageType::Float64;
+    else if (compact_knn_storage<float>.count(__name)) __storage = StorageType::Float32;
+    else if (compact_knn_storage<std::int8_t>.count(__name)) __storage = StorageType::Int8;
+    else return false;
+    return true;
+}
+
+template<class __T>
+void storeCompactDataset(const std::string& __name, const DefaultDataSet<double, std::string>& __source) {
+    auto ds_ptr = new DefaultDataSet<__T, std::string>();
+    ds_ptr->convertFrom(__source);
+    compact_dataset_storage<__T>.insert(std::make_pair(__name, ds_ptr));
+}
+
+template<class __T>
+bool createCompactKNN(const std::string& __name, const std::string& __structure,
+                      const DefaultDataSet<__T, std::string>& __dataset) {
+    BaseKNN<__T, double, std::string>* base_ptr = nullptr;
+    int knn_type = 0;
+    if (__structure == "brute") {
+        base_ptr = new compact_brute_type<__T>(__dataset);
+    } else if (__structure == "kd-tree") {
+        base_ptr = new compact_kd_tree_type<__T>(__dataset);
+        knn_type = 1;
+    } else {
+        return false;
+    }
+    compact_knn_storage<__T>.insert(std::make_pair(__name, std::make_pair(base_ptr, knn_type)));
+    std::cout << "Created KNN instance " << __name << " with structure "
+            << (knn_type ? "KD-Tree" : "Brute") << " (" << storageName(storage_type_of<__T>)
+            << ") at " << base_ptr << '\n';
+    return true;
+}
+
+template<class __T>
+bool compactCrossValidation(const std::string& __structure, const DefaultDataSet<__T, std::string>& __dataset,
+                            int k, int groups, double& __ans) {
+    if (__structure == "brute") {
+        __ans = crossValidation<__T, std::string, compact_brute_type<__T>>(__dataset, k, groups, global_thread_cnt);
+    } else if (__structure == "kd-tree") {
+        __ans = crossValidation<__T, std::string, compact_kd_tree_type<__T>>(__dataset, k, groups, global_thread_cnt);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+template<class __T, class __KNN>
+void rangedCheckWith(const DataSet<__T, std::string>& __dataset, int iterations,
+                     std::pair<int, int> __k_range, int groups, knn_ranged_k_ret_list& __answers) {
+    if (global_thread_cnt > 0) {
+        kRangedCheck<__T, std::string, __KNN>(__dataset, iterations, global_thread_cnt, __k_range, groups, __answers);
+    } else {
+        kRangedCheck<__T, std::string, __KNN>(__dataset, iterations, __k_range, groups, __answers);
+    }
+}
+
+template<class __T>
+bool compactRangedCheck(const std::string& __structure, const DefaultDataSet<__T, std::string>& __dataset,
+                        int iterations, std::pair<int, int> __k_range, int groups,
+                        knn_ranged_k_ret_list& __answers) {
+    if (__structure == "brute") {
+        rangedCheckWith<__T, compact_brute_type<__T>>(__dataset, iterations, __k_range, groups, __answers);
+    } else if (__structure == "kd-tree") {
+        rangedCheckWith<__T, compact_kd_tree_type<__T>>(__dataset, iterations, __k_range, groups, __answers);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/// @brief 将原始单位的查询转换到KNN对象绑定数据集的储存空间后预测并输出
+template<class __T>
+void predictWith(BaseKNN<__T, double, std::string>* __knn,
+                 const std::vector<std::vector<double>>& __queries, int k) {
+    bool multi_flg = (global_thread_cnt > 0) ? true : false;
+    std::cout << "Start prediction with k=" << k << "\nMultithread: "
+            << (multi_flg ? "Enable " : "Disable ") << " Total: "
+            << __queries.size() << '\n';
+    auto dataset = dynamic_cast<const DefaultDataSet<__T, std::string>*>(__knn->getDatasetRef());
+    std::vector<std::vector<__T>> synced_query;
+    std::vector<decltype(__knn->getResultContainer())> batch_result;
+    synced_query.reserve(__queries.size());
+    for (auto& vec : __queries) {
+        synced_query.push_back(dataset->encode(vec));
+    }
+    // 单个查询时在查询内部并行，否则在查询之间并行
+    bool inner_flg = multi_flg && synced_query.size() == 1;
+    if (!inner_flg) __knn->getBatch(synced_query, k, batch_result, global_thread_cnt);
+    int idx = 0;
+    for (auto& vec : __queries) {
+        std::cout << "Prediction " << idx + 1 << " -> ";
+        for (auto& dat : vec) {
+            std::cout << dat << ' ';
+        } std::cout << " :\n";
+
+        if (inner_flg) {
+            auto result = __knn->getResultContainer();
+            __knn->multiThreadGet(synced_query[idx], k, global_thread_cnt, result);
+            collectResult(result, global_detail_print);
+        } else {
+            collectResult(batch_result[idx], global_detail_print);
+        }
+        ++idx;
+    }
+}
+
 bool executeCommand(const std::string& __cmd) {
     executed_cnt += 1;
     std::vector<std::string> args;
@@ -99,6 +282,10 @@ bool executeCommand(const std::string& __cmd) {
             for (auto pair : knn_storage) {
                 delete pair.second.first;
             }
+            for (auto pair : compact_knn_storage<float>) delete pair.second.first;
+            for (auto pair : compact_knn_storage<std::int8_t>) delete pair.second.first;
+            for (auto pair : compact_dataset_storage<float>) delete pair.second;
+            for (auto pair : compact_dataset_storage<std::int8_t>) delete pair.second;
             std::cout << "Command caused exit.\n";
             exit(0);
 
@@ -171,27 +358,70 @@ bool executeCommand(const std::string& __cmd) {
             int k_val;
             binaryRead(k_val, load_file);
             binaryRead(knn_type, load_file);
-            if (knn_type != 'k' && knn_type != 'b') {
+            if (knn_type != 'k' && knn_type != 'b' && knn_type != 'v' && knn_type != 'h' && knn_type != 'p' && knn_type != 'l') {
                 showErr(__cmd, "Unknown knn type: " + knn_type);
                 load_file.close();
                 return false;
             }
+            // float与int8储存的数据集只能绑定brute与kd-tree
+            StorageType storage = peekStorageType(load_file);
+            if (storage != StorageType::Float64) {
+                if (knn_type != 'k' && knn_type != 'b') {
+                    showErr(__cmd, std::string("Structure does not support storage: ") + storageName(storage));
+                    load_file.close();
+                    return false;
+                }
+                k_val_storage.insert(std::make_pair(k_name, k_val));
+                variable_table.insert(k_name);
+                std::string structure(knn_type == 'k' ? "kd-tree" : "brute");
+                if (storage == StorageType::Float32) {
+                    auto dataset_ptr = new DefaultDataSet<float, std::string>();
+                    mapDataset(dataset_ptr, data_path, load_file);
+                    compact_dataset_storage<float>.insert(std::make_pair(dataset_name, dataset_ptr));
+                    createCompactKNN(args[1], structure, *dataset_ptr);
+                } else {
+                    auto dataset_ptr = new DefaultDataSet<std::int8_t, std::string>();
+                    mapDataset(dataset_ptr, data_path, load_file);
+                    compact_dataset_storage<std::int8_t>.insert(std::make_pair(dataset_name, dataset_ptr));
+                    createCompactKNN(args[1], structure, *dataset_ptr);
+                }
+                load_file.close();
+                variable_table.insert(dataset_name);
+                variable_table.insert(args[1]);
+                std::cout << "Successfully load model: " << args[1] << '\n';
+                return true;
+            }
             // header
             auto dataset_ptr = new DefaultDataSet<double, std::string>();
-            dataset_ptr->loadFromBin(load_file);
+            mapDataset(dataset_ptr, data_path, load_file);
             dataset_storage.insert(std::make_pair(dataset_name, dataset_ptr));
             variable_table.insert(dataset_name);
+            // HNSW的图结构，IVFPQ的编码与LSH的参数紧跟在数据集之后
+            if (knn_type == 'h') {
+                auto hnsw_knn_ptr = new hnsw_type(*dataset_ptr, load_file);
+                if (!load_file) std::cout << "HNSW graph in " << data_path << " is invalid, rebuilt" << std::endl;
+                knn_storage.insert({args[1], {hnsw_knn_ptr, 3}});
+            } else if (knn_type == 'p') {
+                auto ivfpq_knn_ptr = new ivfpq_type(*dataset_ptr, load_file);
+                knn_storage.insert({args[1], {ivfpq_knn_ptr, 4}});
+            } else if (knn_type == 'l') {
+                auto lsh_knn_ptr = new lsh_type(*dataset_ptr, load_file);
+                knn_storage.insert({args[1], {lsh_knn_ptr, 5}});
+            }
             load_file.close();
             // put k
             k_val_storage.insert(std::make_pair(k_name, k_val));
             variable_table.insert(k_name);
             // create knn
             if (knn_type == 'k') {
-                auto kd_knn_ptr = new KDTree<double, double, std::string>(*dataset_ptr);
+                auto kd_knn_ptr = new kd_tree_type(*dataset_ptr);
                 knn_storage.insert({args[1], {kd_knn_ptr, 1}});
             } else if (knn_type == 'b') {
-                auto brute_knn_ptr = new Brute<double, double, std::string>(*dataset_ptr);
+                auto brute_knn_ptr = new brute_type(*dataset_ptr);
                 knn_storage.insert({args[1], {brute_knn_ptr, 0}});
+            } else if (knn_type == 'v') {
+                auto vp_knn_ptr = new vp_tree_type(*dataset_ptr);
+                knn_storage.insert({args[1], {vp_knn_ptr, 2}});
             }
             variable_table.insert(args[1]);
             std::cout << "Successfully load model: " << args[1] << '\n';
@@ -203,14 +433,14 @@ bool executeCommand(const std::string& __cmd) {
                 showErr(__cmd, "Expected format: save <knn> <k> <save_name>");
                 return false;
             }
-            auto iter = knn_storage.find(args[1]);
-            if (iter == knn_storage.end()) {
+            StorageType storage;
+            if (!findKNN(args[1], storage)) {
                 showErr(__cmd, "Cannot find knn object: " + args[1]);
                 return false;
             }
             // generate paths
             std::string save_path(".\\saves\\" + args[3] + ".knn");
-            char knn_type{iter->second.second == 1 ? 'k' : 'b'};
+            const char type_chars[] = {'b', 'k', 'v', 'h', 'p', 'l'};
             if (checkFile(save_path)) {
                 showErr(__cmd, "Model already exists:" + args[3]);
                 return false;
@@ -220,10 +450,38 @@ bool executeCommand(const std::string& __cmd) {
             int write_k; fromStr(args[2], write_k);
             // Header
             binaryWrite(write_k, save_file);
+            // 数据集的储存类型标记在其自身的二进制格式中
+            if (storage == StorageType::Float32) {
+                auto iter = compact_knn_storage<float>.find(args[1]);
+                binaryWrite(type_chars[iter->second.second], save_file);
+                dynamic_cast<const DefaultDataSet<float, std::string>*>(iter->second.first->getDatasetRef())
+                    ->saveToBin(save_file);
+            } else if (storage == StorageType::Int8) {
+                auto iter = compact_knn_storage<std::int8_t>.find(args[1]);
+                binaryWrite(type_chars[iter->second.second], save_file);
+                dynamic_cast<const DefaultDataSet<std::int8_t, std::string>*>(iter->second.first->getDatasetRef())
+                    ->saveToBin(save_file);
+            }
+            if (storage != StorageType::Float64) {
+                save_file.close();
+                std::cout << "Successfully save model " << args[1] << " with name " << args[3] << '\n';
+                return true;
+            }
+            auto iter = knn_storage.find(args[1]);
+            char knn_type{type_chars[iter->second.second]};
             binaryWrite(knn_type, save_file);
             auto knn_obj = iter->second.first;
             auto dataset_ptr = dynamic_cast<const DefaultDataSet<double, std::string>*>(knn_obj->getDatasetRef());
-            dataset_ptr->saveToBin(save_file);
+            // compact只保存IVFPQ的编码与标签，数据集只保留维度与标准化参数
+            const bool compact = iter->second.second == 4 && args.size() >= 5 && args[4] == "compact";
+            dataset_ptr->saveToBin(save_file, !compact);
+            if (iter->second.second == 3) {
+                dynamic_cast<const hnsw_type*>(knn_obj)->saveGraph(save_file);
+            } else if (iter->second.second == 4) {
+                dynamic_cast<const ivfpq_type*>(knn_obj)->saveIndex(save_file);
+            } else if (iter->second.second == 5) {
+                dynamic_cast<const lsh_type*>(knn_obj)->saveIndex(save_file);
+            }
             save_file.close();
 
             std::cout << "Successfully save model " << args[1] << " with name " << args[3] << '\n';
@@ -232,10 +490,20 @@ bool executeCommand(const std::string& __cmd) {
         } else if (args[0] == "dataset") {
             // err
             if (args.size() < 4) {
-                showErr(__cmd, "Expected format: dataset <variable_name> <type> <file_path> [sep]");
+                showErr(__cmd, "Expected format: dataset <variable_name> <type> <file_path> [sep] [float64/float32/int8]");
                 return false;
             }
-            char arg_sep = (args.size() >= 5 ? args[4][0] : -1);
+            // 储存类型可直接跟在文件路径之后，此时使用默认分隔符
+            StorageType storage = StorageType::Float64;
+            char arg_sep = -1;
+            for (int i = 4; i < args.size(); ++i) {
+                if (parseStorage(args[i], storage)) continue;
+                if (i == 4) arg_sep = args[4][0];
+                else {
+                    showErr(__cmd, "Unknown storage: " + args[i]);
+                    return false;
+                }
+            }
 
             // name check
             auto it = variable_table.find(args[1]);
@@ -249,12 +517,26 @@ bool executeCommand(const std::string& __cmd) {
                 return false;
             }
             // do bin first
+            // 二进制数据集的储存类型由文件决定
             if (args[2] == "bin") {
-                auto ds_ptr = new DefaultDataSet<double, std::string>();
-                ds_ptr->loadFromBin(args[3].c_str());
-                dataset_storage.insert(std::make_pair(args[1], ds_ptr));
+                std::ifstream bin_in(args[3], std::ios::in | std::ios::binary);
+                storage = peekStorageType(bin_in);
+                bin_in.close();
+                if (storage == StorageType::Float32) {
+                    auto ds_ptr = new DefaultDataSet<float, std::string>();
+                    ds_ptr->loadFromBin(args[3].c_str());
+                    compact_dataset_storage<float>.insert(std::make_pair(args[1], ds_ptr));
+                } else if (storage == StorageType::Int8) {
+                    auto ds_ptr = new DefaultDataSet<std::int8_t, std::string>();
+                    ds_ptr->loadFromBin(args[3].c_str());
+                    compact_dataset_storage<std::int8_t>.insert(std::make_pair(args[1], ds_ptr));
+                } else {
+                    auto ds_ptr = new DefaultDataSet<double, std::string>();
+                    ds_ptr->loadFromBin(args[3].c_str());
+                    dataset_storage.insert(std::make_pair(args[1], ds_ptr));
+                }
                 variable_table.insert(args[1]);
-                std::cout << "Created dataset instance: " << args[1] << '\n';
+                std::cout << "Created dataset instance: " << args[1] << " (" << storageName(storage) << ")\n";
                 return true;
             }
             // check if raw
@@ -263,49 +545,35 @@ bool executeCommand(const std::string& __cmd) {
                 return false;
             }
             // predict
-            std::ifstream check_in(args[3], std::ios::in);
-            std::string check_buf;
-            std::vector<std::string> check_list;
-            int skipped_lines = -1;
-            do {
-                ++skipped_lines;
-                std::getline(check_in, check_buf);
-                if (!check_in) break;
-                if (!check_buf.size()) continue;
-                bool valid = true;
-                cfg::splitString(check_buf, check_list, arg_sep);
-                for (int index = 0; index < check_list.size() - 1 && valid; ++index) {
-                    for (char chr : check_list[index]) {
-                        if (!((chr >= '0' && chr <= '9') || chr == '.')) {
-                            valid = false;
-                            break;
-                        }
-                    }
-                }
-                if (!valid) continue;
-                else break;
-            } while (true);
-            check_in.close();
-            
-            std::cout << "Skipped lines: " << skipped_lines << '\n';
-            std::cout << "Predict line: " << check_buf << '\n';
-            int dimension = check_list.size() - 1;
+            CsvLayout layout = detectCsvLayout(args[3].c_str(), arg_sep);
+            std::cout << "Skipped lines: " << layout.skipped << '\n';
+            std::cout << "Predict line: " << layout.first_line << '\n';
+            long long dimension = layout.dimension;
             std::cout << "Predict dimension: " << dimension << '\n';
 
             auto ds_ptr = new DefaultDataSet<double, std::string>(dimension);
-            readDatasetFile(args[3].c_str(), *ds_ptr,
-                            DefaultReadLine<double, std::string>(arg_sep, dimension), skipped_lines);
-            dataset_storage.insert(std::make_pair(args[1], ds_ptr));
+            readDatasetFile(args[3].c_str(), *ds_ptr, DefaultReadLine<double, std::string>(arg_sep, dimension),
+                            layout.skipped, global_thread_cnt);
+            // 文本总是按double读取，再转换到所选的储存类型
+            if (storage == StorageType::Float32) {
+                storeCompactDataset<float>(args[1], *ds_ptr);
+                delete ds_ptr;
+            } else if (storage == StorageType::Int8) {
+                storeCompactDataset<std::int8_t>(args[1], *ds_ptr);
+                delete ds_ptr;
+            } else {
+                dataset_storage.insert(std::make_pair(args[1], ds_ptr));
+            }
             variable_table.insert(args[1]);
 
-            std::cout << "Created dataset instance: " << args[1] << '\n';
+            std::cout << "Created dataset instance: " << args[1] << " (" << storageName(storage) << ")\n";
             return true;
 
         } else if (args[0] == "knn") {
             // err
             if (args.size() < 4) {
-                showErr(__cmd, "Expected format: knn <variable_name> <structure> <dataset>"
-                        "\n\t structure can only be 'brute' or 'kd-tree'");
+                showErr(__cmd, "Expected format: knn <variable_name> <structure> <dataset> [structure args]"
+                        "\n\t structure can only be 'brute', 'kd-tree', 'vp-tree', 'hnsw', 'ivfpq' or 'lsh'");
                 return false;
             }
 
@@ -315,27 +583,89 @@ bool executeCommand(const std::string& __cmd) {
                 showErr(__cmd, "Redefined variable: " + args[1]);
                 return false;
             }
-            auto dit = dataset_storage.find(args[3]);
-            if (dit == dataset_storage.end()) {
+            StorageType storage;
+            if (!findDataset(args[3], storage)) {
                 showErr(__cmd, "Cannot find dataset instance: " + args[3]);
                 return false;
             }
+            if (storage != StorageType::Float64) {
+                bool created = (storage == StorageType::Float32)
+                    ? createCompactKNN(args[1], args[2], *compact_dataset_storage<float>[args[3]])
+                    : createCompactKNN(args[1], args[2], *compact_dataset_storage<std::int8_t>[args[3]]);
+                if (!created) {
+                    showErr(__cmd, "Structure does not support storage " + std::string(storageName(storage))
+                            + ": " + args[2]);
+                    return false;
+                }
+                variable_table.insert(args[1]);
+                return true;
+            }
+            auto dit = dataset_storage.find(args[3]);
             
             // type diff
             if (args[2] == "kd-tree") {
-                auto knn_ptr = new KDTree<double, double, std::string>(*(dit->second));
+                auto knn_ptr = new kd_tree_type(*(dit->second));
                 auto base_ptr = dynamic_cast<BaseKNN<double, double, std::string>*>(knn_ptr);
                 knn_storage.insert(std::make_pair(args[1], std::make_pair(base_ptr, 1)));
                 variable_table.insert(args[1]);
                 std::cout << "Created KNN instance " << args[1] << " with structure KD-Tree at " << base_ptr << '\n';
                 return true;
             } else if (args[2] == "brute") {
-                auto knn_ptr = new Brute<double, double, std::string>(*(dit->second));
+                auto knn_ptr = new brute_type(*(dit->second));
                 auto base_ptr = dynamic_cast<BaseKNN<double, double, std::string>*>(knn_ptr);
                 knn_storage.insert(std::make_pair(args[1], std::make_pair(base_ptr, 0)));
                 variable_table.insert(args[1]);
                 std::cout << "Created KNN instance " << args[1] << " with structure Brute at " << base_ptr << '\n';
                 return true;
+            } else if (args[2] == "vp-tree") {
+                auto knn_ptr = new vp_tree_type(*(dit->second));
+                auto base_ptr = dynamic_cast<BaseKNN<double, double, std::string>*>(knn_ptr);
+                knn_storage.insert(std::make_pair(args[1], std::make_pair(base_ptr, 2)));
+                variable_table.insert(args[1]);
+                std::cout << "Created KNN instance " << args[1] << " with structure VP-Tree at " << base_ptr << '\n';
+                return true;
+            } else if (args[2] == "hnsw") {
+                HNSWParam param;
+                if (args.size() >= 5) fromStr(args[4], param.M);
+                if (args.size() >= 6) fromStr(args[5], param.ef_construction);
+                if (args.size() >= 7) fromStr(args[6], param.ef_search);
+                auto knn_ptr = new hnsw_type(*(dit->second), param);
+                auto base_ptr = dynamic_cast<BaseKNN<double, double, std::string>*>(knn_ptr);
+                knn_storage.insert(std::make_pair(args[1], std::make_pair(base_ptr, 3)));
+                variable_table.insert(args[1]);
+                std::cout << "Created KNN instance " << args[1] << " with structure HNSW (M="
+                        << knn_ptr->getParam().M << ", efConstruction=" << knn_ptr->getParam().ef_construction
+                        << ", efSearch=" << knn_ptr->getParam().ef_search << ") at " << base_ptr << '\n';
+                return true;
+            } else if (args[2] == "ivfpq") {
+                IVFPQParam param;
+                if (args.size() >= 5) fromStr(args[4], param.nlist);
+                if (args.size() >= 6) fromStr(args[5], param.m);
+                if (args.size() >= 7) fromStr(args[6], param.nprobe);
+                if (args.size() >= 8) fromStr(args[7], param.rerank);
+                auto knn_ptr = new ivfpq_type(*(dit->second), param);
+                auto base_ptr = dynamic_cast<BaseKNN<double, double, std::string>*>(knn_ptr);
+                knn_storage.insert(std::make_pair(args[1], std::make_pair(base_ptr, 4)));
+                variable_table.insert(args[1]);
+                std::cout << "Created KNN instance " << args[1] << " with structure IVF-PQ (nprobe="
+                        << knn_ptr->getParam().nprobe << ", rerank=" << knn_ptr->getParam().rerank
+                        << ") at " << base_ptr << '\n';
+                return true;
+            } else if (args[2] == "lsh") {
+                LSHParam param;
+                if (args.size() >= 5) fromStr(args[4], param.tables);
+                if (args.size() >= 6) fromStr(args[5], param.bits);
+                if (args.size() >= 7) fromStr(args[6], param.probes);
+                if (args.size() >= 8) fromStr(args[7], param.bucket_width);
+                auto knn_ptr = new lsh_type(*(dit->second), param);
+                auto base_ptr = dynamic_cast<BaseKNN<double, double, std::string>*>(knn_ptr);
+                knn_storage.insert(std::make_pair(args[1], std::make_pair(base_ptr, 5)));
+                variable_table.insert(args[1]);
+                std::cout << "Created KNN instance " << args[1] << " with structure LSH (tables="
+                        << knn_ptr->getParam().tables << ", bits=" << knn_ptr->getParam().bits
+                        << ", probes=" << knn_ptr->getParam().probes << ", width=" << knn_ptr->getParam().bucket_width
+                        << ") at " << base_ptr << '\n';
+                return true;
             } else {
                 showErr(__cmd, "Unknown structure: " + args[2]);
                 return false;
@@ -344,23 +674,41 @@ bool executeCommand(const std::string& __cmd) {
         } else if (args[0] == "cv") {
             // err
             if (args.size() < 5) {
-                showErr(__cmd, "Expected format: cv <dataset> <brute/kd-tree> <k> <group_cnt>");
+                showErr(__cmd, "Expected format: cv <dataset> <brute/kd-tree/vp-tree/hnsw/ivfpq/lsh> <k> <group_cnt>");
                 return false;
             }
             // check dataset
-            auto dit = dataset_storage.find(args[1]);
-            if (dit == dataset_storage.end()) {
+            StorageType storage;
+            if (!findDataset(args[1], storage)) {
                 showErr(__cmd, "Cannot find dataset object: " + args[1]);
                 return false;
             }
+            auto dit = dataset_storage.find(args[1]);
             // diff mode
             double ans = 0.0;
             int k; fromStr(args[3], k);
             int groups; fromStr(args[4], groups);
-            if (args[2] == "brute") {
-                ans = crossValidation<double, std::string, Brute<double, double, std::string>>(*(dit->second), k, groups);
+            if (storage != StorageType::Float64) {
+                bool supported = (storage == StorageType::Float32)
+                    ? compactCrossValidation(args[2], *compact_dataset_storage<float>[args[1]], k, groups, ans)
+                    : compactCrossValidation(args[2], *compact_dataset_storage<std::int8_t>[args[1]], k, groups, ans);
+                if (!supported) {
+                    showErr(__cmd, "Unknown knn structure for storage " + std::string(storageName(storage))
+                            + ": " + args[2]);
+                    return false;
+                }
+            } else if (args[2] == "brute") {
+                ans = crossValidation<double, std::string, brute_type>(*(dit->second), k, groups, global_thread_cnt);
             } else if (args[2] == "kd-tree") {
-                ans = crossValidation<double, std::string, KDTree<double, double, std::string>>(*(dit->second), k, groups);
+                ans = crossValidation<double, std::string, kd_tree_type>(*(dit->second), k, groups, global_thread_cnt);
+            } else if (args[2] == "vp-tree") {
+                ans = crossValidation<double, std::string, vp_tree_type>(*(dit->second), k, groups, global_thread_cnt);
+            } else if (args[2] == "hnsw") {
+                ans = crossValidation<double, std::string, hnsw_type>(*(dit->second), k, groups, global_thread_cnt);
+            } else if (args[2] == "ivfpq") {
+                ans = crossValidation<double, std::string, ivfpq_type>(*(dit->second), k, groups, global_thread_cnt);
+            } else if (args[2] == "lsh") {
+                ans = crossValidation<double, std::string, lsh_type>(*(dit->second), k, groups, global_thread_cnt);
             } else {
                 showErr(__cmd, "Unknown knn structure: " + args[2]);
                 return false;
@@ -371,7 +719,7 @@ bool executeCommand(const std::string& __cmd) {
         } 
         else if (args[0] == "range") {
             if (args.size() < 7) {
-                showErr(__cmd, "Expected format: range <begin> <end> <iteration> <group_cnt> <dataset> <brute/kd-tree>");
+                showErr(__cmd, "Expected format: range <begin> <end> <iteration> <group_cnt> <dataset> <brute/kd-tree/vp-tree/hnsw/ivfpq/lsh>");
                 return false;
             }
             // check range
@@ -389,31 +737,75 @@ bool executeCommand(const std::string& __cmd) {
                 return false;
             }
             // check dataset
-            auto dit = dataset_storage.find(args[5]);
-            if (dit == dataset_storage.end()) {
+            StorageType storage;
+            if (!findDataset(args[5], storage)) {
                 showErr(__cmd, "Cannot find dataset object: " + args[5]);
                 return false;
             }
+            auto dit = dataset_storage.find(args[5]);
             // diff mode
             std::cout << "Start ranged k check from " << k_begin << " to "
                     << k_end << "\nIteration count: " << iterations << " Use threads: "
                     << global_thread_cnt << "\nUse diagram: " << global_range_diag
                     << " Group count: " << groups << '\n';
             knn_ranged_k_ret_list answers;
-            if (args[6] == "brute") {
+            if (storage != StorageType::Float64) {
+                bool supported = (storage == StorageType::Float32)
+                    ? compactRangedCheck(args[6], *compact_dataset_storage<float>[args[5]],
+                                         iterations, {k_begin, k_end}, groups, answers)
+                    : compactRangedCheck(args[6], *compact_dataset_storage<std::int8_t>[args[5]],
+                                         iterations, {k_begin, k_end}, groups, answers);
+                if (!supported) {
+                    showErr(__cmd, "Unknown knn structure for storage " + std::string(storageName(storage))
+                            + ": " + args[6]);
+                    return false;
+                }
+            } else if (args[6] == "brute") {
                 if (global_thread_cnt > 0) {
-                    kRangedCheck<double, std::string, Brute<double, double, std::string>>
+                    kRangedCheck<double, std::string, brute_type>
                     (*(dit->second), iterations, global_thread_cnt, {k_begin, k_end}, groups, answers);
                 } else {
-                    kRangedCheck<double, std::string, Brute<double, double, std::string>>
+                    kRangedCheck<double, std::string, brute_type>
                     (*(dit->second), iterations, {k_begin, k_end}, groups, answers);
                 }
             } else if (args[6] == "kd-tree") {
                 if (global_thread_cnt > 0) {
-                    kRangedCheck<double, std::string, KDTree<double, double, std::string>>
+                    kRangedCheck<double, std::string, kd_tree_type>
                     (*(dit->second), iterations, global_thread_cnt, {k_begin, k_end}, groups, answers);
                 } else {
-                    kRangedCheck<double, std::string, KDTree<double, double, std::string>>
+                    kRangedCheck<double, std::string, kd_tree_type>
+                    (*(dit->second), iterations, {k_begin, k_end}, groups, answers);
+                }
+            } else if (args[6] == "vp-tree") {
+                if (global_thread_cnt > 0) {
+                    kRangedCheck<double, std::string, vp_tree_type>
+                    (*(dit->second), iterations, global_thread_cnt, {k_begin, k_end}, groups, answers);
+                } else {
+                    kRangedCheck<double, std::string, vp_tree_type>
+                    (*(dit->second), iterations, {k_begin, k_end}, groups, answers);
+                }
+            } else if (args[6] == "hnsw") {
+                if (global_thread_cnt > 0) {
+                    kRangedCheck<double, std::string, hnsw_type>
+                    (*(dit->second), iterations, global_thread_cnt, {k_begin, k_end}, groups, answers);
+                } else {
+                    kRangedCheck<double, std::string, hnsw_type>
+                    (*(dit->second), iterations, {k_begin, k_end}, groups, answers);
+                }
+            } else if (args[6] == "ivfpq") {
+                if (global_thread_cnt > 0) {
+                    kRangedCheck<double, std::string, ivfpq_type>
+                    (*(dit->second), iterations, global_thread_cnt, {k_begin, k_end}, groups, answers);
+                } else {
+                    kRangedCheck<double, std::string, ivfpq_type>
+                    (*(dit->second), iterations, {k_begin, k_end}, groups, answers);
+                }
+            } else if (args[6] == "lsh") {
+                if (global_thread_cnt > 0) {
+                    kRangedCheck<double, std::string, lsh_type>
+                    (*(dit->second), iterations, global_thread_cnt, {k_begin, k_end}, groups, answers);
+                } else {
+                    kRangedCheck<double, std::string, lsh_type>
                     (*(dit->second), iterations, {k_begin, k_end}, groups, answers);
                 }
             } else {
@@ -456,8 +848,8 @@ bool executeCommand(const std::string& __cmd) {
                 return false;
             }
             // check knn
-            auto kit = knn_storage.find(knn_name);
-            if (kit == knn_storage.end()) {
+            StorageType storage;
+            if (!findKNN(knn_name, storage)) {
                 showErr(__cmd, "Cannot find knn object: " + knn_name);
                 return false;
             }
@@ -497,7 +889,7 @@ bool executeCommand(const std::string& __cmd) {
                 return false;
             }
             // check multi
-            int k, idx = 0; fromStr(k_str_val, k);
+            int k; fromStr(k_str_val, k);
             if (k <= 0) {
                 auto iter = k_val_storage.find("k_" + knn_name);
                 if (iter == k_val_storage.end()) {
@@ -507,24 +899,12 @@ bool executeCommand(const std::string& __cmd) {
                     k = iter->second;
                 }
             }
-            bool multi_flg = (global_thread_cnt > 0) ? true : false;
-            std::cout << "Start prediction with k=" << k << "\nMultithread: "
-                    << (multi_flg ? "Enable " : "Disable ") << " Total: "
-                    << wait_query.size() << '\n';
-            // start predict
-            auto dataset = kit->second.first->getDatasetRef();
-            for (auto& vec : wait_query) {
-                ++idx;
-                std::cout << "Prediction " << idx << " -> ";
-                for (auto& dat : vec) {
-                    std::cout << dat << ' ';
-                } std::cout << " :\n";
-
-                auto result = kit->second.first->getResultContainer();
-                auto temp_sync = dataset->syncNormalization(vec);
-                if (multi_flg) kit->second.first->multiThreadGet(temp_sync, k, global_thread_cnt, result);
-                else kit->second.first->get(temp_sync, k, result);
-                collectResult(result, global_detail_print);
+            if (storage == StorageType::Float32) {
+                predictWith(compact_knn_storage<float>[knn_name].first, wait_query, k);
+            } else if (storage == StorageType::Int8) {
+                predictWith(compact_knn_storage<std::int8_t>[knn_name].first, wait_query, k);
+            } else {
+                predictWith(knn_storage[knn_name].first, wait_query, k);
             }
             std::cout << "Prediction finished.\n";
             return true;
@@ -534,12 +914,30 @@ bool executeCommand(const std::string& __cmd) {
             for (auto it : dataset_storage) {
                 std::cout << it.first << " at " << it.second << '\n';
             }
+            for (auto it : compact_dataset_storage<float>) {
+                std::cout << it.first << " at " << it.second << " storage: float32\n";
+            }
+            for (auto it : compact_dataset_storage<std::int8_t>) {
+                std::cout << it.first << " at " << it.second << " storage: int8\n";
+            }
             std::cout << "\nKNN objects:\n";
             for (auto it : knn_storage) {
                 std::cout << it.first << " at " << it.second.first << " structure: ";
                 if (it.second.second == 1) std::cout << "kd-tree\n";
+                else if (it.second.second == 2) std::cout << "vp-tree\n";
+                else if (it.second.second == 3) std::cout << "hnsw\n";
+                else if (it.second.second == 4) std::cout << "ivfpq\n";
+                else if (it.second.second == 5) std::cout << "lsh\n";
                 else std::cout << "brute\n";
             }
+            for (auto it : compact_knn_storage<float>) {
+                std::cout << it.first << " at " << it.second.first << " structure: "
+                        << (it.second.second == 1 ? "kd-tree" : "brute") << " storage: float32\n";
+            }
+            for (auto it : compact_knn_storage<std::int8_t>) {
+                std::cout << it.first << " at " << it.second.first << " structure: "
+                        << (it.second.second == 1 ? "kd-tree" : "brute") << " storage: int8\n";
+            }
             std::cout << "\nStored K values:\n";
             for (auto it : k_val_storage) {
                 std::cout << it.first << ':' << it.second << '\n';
@@ -550,14 +948,24 @@ bool executeCommand(const std::string& __cmd) {
                 "启动时可附加参数，该参数为需要执行的命令文件路径。" 
                 "可用的命令：\n"
                 "\ndataset -> 创建数据集对象\n\t"
-                "格式: dataset <变量名> <文件类型> <文件路径> [分隔符]\n\t"
+                "格式: dataset <变量名> <文件类型> <文件路径> [分隔符] [储存类型]\n\t"
                 "文件类型只能在raw和bin中选其一。\n\t"
                 "若选择raw，则将数据集每行按分隔符分隔，若省略则按空白字符分隔。数据维数自动检测。\n\t"
-                "若选择bin，则按KNN.hpp中设置的模式读取以二进制保存的数据集。此时分隔符参数被忽略。\n"
+                "若选择bin，则按KNN.hpp中设置的模式读取以二进制保存的数据集。此时分隔符与储存类型参数被忽略。\n\t"
+                "储存类型只能在'float64', 'float32'和'int8'中选其一，默认为float64。\n\t"
+                "float32占用减半；int8按维度线性量化，占用为八分之一，不能再进行标准化。\n\t"
+                "float32与int8数据集只能使用'brute'和'kd-tree'，预测时输入原始单位的向量即可。\n"
                 "\nknn -> 创建KNN对象\n\t"
                 "格式: knn <变量名> <计算方法> <绑定数据集>\n\t"
                 "绑定数据集应为已经创建了的数据集对象的变量名。\n\t"
-                "计算方法参数只能'brute'和'kd-tree'选其一。\n"
+                "计算方法参数只能在'brute', 'kd-tree', 'vp-tree', 'hnsw', 'ivfpq'和'lsh'中选其一。\n\t"
+                "vp-tree使用欧氏距离，适合维数较高的数据集。\n\t"
+                "hnsw为近似查询，可附加参数: knn <变量名> hnsw <绑定数据集> [M] [efConstruction] [efSearch]\n\t"
+                "创建后可用 <变量名> ef <值> 调整efSearch。\n\t"
+                "ivfpq为压缩的近似查询，可附加参数: knn <变量名> ivfpq <绑定数据集> [nlist] [m] [nprobe] [rerank]\n\t"
+                "创建后可用 <变量名> nprobe <值> 与 <变量名> rerank <值> 调整。\n\t"
+                "lsh为基于欧氏距离随机投影的近似查询，可附加参数: knn <变量名> lsh <绑定数据集> [tables] [bits] [probes] [width]\n\t"
+                "创建后可用 <变量名> probes <值> 调整每个哈希表额外探测的桶数。\n"
                 "\npredict -> 用指定KNN对象预测未知数据\n\t"
                 "格式: predict <KNN对象名> [k] <数据来源> {数据}/<文件路径>\n\t"
                 "数据来源参数只能'file'和'direct'选其一\n\t"
@@ -570,10 +978,10 @@ bool executeCommand(const std::string& __cmd) {
                 "格式: variables\n"
                 "\ncv -> 对指定数据集进行关于k的交叉验证\n\t"
                 "格式: cv <数据集> <计算方法> <k> <分组数量>\n\t"
-                "计算方法参数只能'brute'和'kd-tree'选其一。\n"
+                "计算方法参数只能在'brute', 'kd-tree', 'vp-tree', 'hnsw', 'ivfpq'和'lsh'中选其一。\n"
                 "\nrange -> 对区间内的k批量交叉验证并统计输出\n\t"
                 "格式: range <开始k> <结束k> <重复次数> <分组数量> <数据集> <计算方法>\n\t"
-                "计算方法参数只能'brute'和'kd-tree'选其一。\n\t"
+                "计算方法参数只能在'brute', 'kd-tree', 'vp-tree', 'hnsw', 'ivfpq'和'lsh'中选其一。\n\t"
                 "配置文件中useRangedDiagram选项控制统计输出是否启用图表\n\t"
                 "配置文件中diagramHeight选项控制图表高度\n"
                 "\nfunction -> 执行命令文件\n\t"
@@ -586,8 +994,9 @@ bool executeCommand(const std::string& __cmd) {
                 "格式: k_val <变量名标识符> <值>\n\t"
                 "储存中名为\"k_{KNN对象名}\"的k值将在对对应KNN对象执行predict命令时被用作默认k值。\n"
                 "\nsave -> 保存KNN对象及其链接的数据集\n\t"
-                "格式: save <KNN对象名> <k> <组合名称>\n\t"
+                "格式: save <KNN对象名> <k> <组合名称> [compact]\n\t"
                 "将已创建的KNN对象与K参数和数据集组合保存。\n\t"
+                "对ivfpq对象附加compact时不保存原始向量，只保存编码与标签，加载后不能重排。\n\t"
                 "组合文件以二进制形式保存在 .\\saves 中。\n"
                 "\nload -> 加载保存的KNN对象\n\t"
                 "格式: load <组合名称>\n\t"
@@ -611,13 +1020,41 @@ bool executeCommand(const std::string& __cmd) {
                     var_type = 2; // knn
                 }
             }
+            // float与int8储存的对象
+            StorageType storage;
+            if (findDataset(args[0], storage) && storage != StorageType::Float64) {
+                auto f32_it = compact_dataset_storage<float>.find(args[0]);
+                if (args.size() == 1) {
+                    std::cout << "Dataset object " << args[0] << " (" << storageName(storage) << ") at "
+                            << (f32_it != compact_dataset_storage<float>.end() ? (void*)(f32_it->second)
+                                : (void*)(compact_dataset_storage<std::int8_t>[args[0]])) << '\n';
+                    std::cout << "Available args:" << (storage == StorageType::Float32 ? " z-score min-max robust" : "") << '\n';
+                    return true;
+                }
+                bool ret = (storage == StorageType::Float32)
+                    ? operateDataset(args, f32_it->second)
+                    : operateDataset(args, compact_dataset_storage<std::int8_t>[args[0]]);
+                if (!ret) showErr(__cmd, "Unknown arg for dataset operation.");
+                return ret;
+            }
+            if (findKNN(args[0], storage) && storage != StorageType::Float64) {
+                if (args.size() == 1) {
+                    std::cout << "KNN object " << args[0] << " (" << storageName(storage) << ") at "
+                            << (storage == StorageType::Float32 ? (void*)(compact_knn_storage<float>[args[0]].first)
+                                : (void*)(compact_knn_storage<std::int8_t>[args[0]].first)) << '\n';
+                    std::cout << "Available args:\n";
+                    return true;
+                }
+                showErr(__cmd, "Unknown arg for knn operation");
+                return false;
+            }
             // second find
             if (var_type == 1) {
                 auto it = dataset_storage.find(args[0]);
                 if (args.size() == 1) {
                     std::cout << "Dataset object " << args[0]
                             << " at " << (void*)(it->second) << '\n';
-                    std::cout << "Available args: z-score\n";
+                    std::cout << "Available args: z-score min-max robust\n";
                     return true;
                 } else {
                     bool ret = operateDataset(args, it->second);
@@ -629,7 +1066,11 @@ bool executeCommand(const std::string& __cmd) {
                 if (args.size() == 1) {
                     std::cout << "KNN object " << args[0]
                             << " at " << (void*)(it->second.first) << '\n';
-                    std::cout << "Available args:\n";
+                    std::cout << "Available args:";
+                    if (it->second.second == 3) std::cout << " ef <efSearch>";
+                    if (it->second.second == 4) std::cout << " nprobe <value>, rerank <value>";
+                    if (it->second.second == 5) std::cout << " probes <value>";
+                    std::cout << '\n';
                     return true;
                 } else {
                     bool ret = operateKNN(args, it->second.second, it->second.first);
@@ -703,6 +1144,8 @@ int main(int argc, char* argv[]) {
     std::string win_unicode;
     global_cfg.get_helper("windowsUnicode", win_unicode);
     if (win_unicode == "true") system("chcp 65001");
+    // 所有并行路径共用一个线程池
+    if (global_thread_cnt > 0) ThreadPool::configure(global_thread_cnt);
 
 
     std::cout << "Launch with config:\n"
@@ -0,0 +1,765 @@
+/*
+ * @Date: 2024-06-14 11:30:00
+ * @Author: DarkskyX15
+ * @LastEditTime: 2024-06-14 11:30:00
+ */
+#ifndef DS_KNN_SIMD_HPP
+#define DS_KNN_SIMD_HPP
+
+#if __cplusplus >= 201703L
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KNN_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#else
+#define KNN_SIMD_X86 0
+#endif
+
+// GCC/Clang需要为每个内核单独开启指令集，MSVC可直接使用内建函数
+#if KNN_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define KNN_TARGET_SSE2 __attribute__((target("sse2")))
+#define KNN_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define KNN_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define KNN_TARGET_SSE2
+#define KNN_TARGET_AVX2
+#define KNN_TARGET_AVX512
+#endif
+
+/// @brief 距离计算的向量化内核，启动时按CPUID选择实现
+namespace knn::simd {
+
+    /// @brief 可用的指令集等级
+    enum class Level : int { scalar = 0, sse2 = 1, avx2 = 2, avx512 = 3 };
+
+    /// @brief 检测当前CPU支持的最高指令集等级
+    inline Level detectLevel() {
+#if KNN_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) return Level::avx512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return Level::avx2;
+        if (__builtin_cpu_supports("sse2")) return Level::sse2;
+        return Level::scalar;
+#elif KNN_SIMD_X86 && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int max_leaf = info[0];
+        __cpuid(info, 1);
+        bool sse2 = (info[3] >> 26) & 1;
+        bool fma = (info[2] >> 12) & 1;
+        bool os_avx = ((info[2] >> 27) & 1) && ((info[2] >> 28) & 1);
+        unsigned long long xcr0 = os_avx ? _xgetbv(0) : 0;
+        bool ymm_state = (xcr0 & 0x6) == 0x6;
+        bool zmm_state = (xcr0 & 0xe6) == 0xe6;
+        bool avx2 = false, avx512 = false;
+        if (max_leaf >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] >> 5) & 1;
+            avx512 = (info[1] >> 16) & 1;
+        }
+        if (avx512 && zmm_state) return Level::avx512;
+        if (avx2 && fma && ymm_state) return Level::avx2;
+        if (sse2) return Level::sse2;
+        return Level::scalar;
+#else
+        return Level::scalar;
+#endif
+    }
+
+    /* 标量实现 */
+
+    template<class __T>
+    inline __T squaredL2Scalar(const __T* __a, const __T* __b, long long __n) {
+        __T dis{0};
+        for (long long i = 0; i < __n; ++i) {
+            __T z = __a[i] - __b[i];
+            dis += z * z;
+        }
+        return dis;
+    }
+    template<class __T>
+    inline __T l1Scalar(const __T* __a, const __T* __b, long long __n) {
+        __T dis{0};
+        for (long long i = 0; i < __n; ++i) {
+            dis += std::abs(__a[i] - __b[i]);
+        }
+        return dis;
+    }
+
+    /// @brief 以更宽的类型`__W`累加，用于`float`与`int8`储存
+    template<class __W, class __T>
+    inline __W squaredL2WideScalar(const __T* __a, const __T* __b, long long __n) {
+        __W dis{0};
+        for (long long i = 0; i < __n; ++i) {
+            __W z = static_cast<__W>(__a[i]) - static_cast<__W>(__b[i]);
+            dis += z * z;
+        }
+        return dis;
+    }
+    template<class __W, class __T>
+    inline __W l1WideScalar(const __T* __a, const __T* __b, long long __n) {
+        __W dis{0};
+        for (long long i = 0; i < __n; ++i) {
+            __W z = static_cast<__W>(__a[i]) - static_cast<__W>(__b[i]);
+            dis += (z < __W{0}) ? -z : z;
+        }
+        return dis;
+    }
+
+    template<class __T>
+    inline void packedDotScalar(const __T* __packed, long long __block, long long __dim,
+                                const __T* __q, __T* __out) {
+        for (long long r = 0; r < __block; ++r) __out[r] = __T{0};
+        for (long long j = 0; j < __dim; ++j) {
+            const __T qj = __q[j];
+            const __T* col = __packed + j * __block;
+            for (long long r = 0; r < __block; ++r) __out[r] += qj * col[r];
+        }
+    }
+
+#if KNN_SIMD_X86
+
+    /* SSE2 */
+
+    KNN_TARGET_SSE2 inline float hsum128(__m128 __v) {
+        __m128 shuf = _mm_shuffle_ps(__v, __v, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128 sums = _mm_add_ps(__v, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+    KNN_TARGET_SSE2 inline double hsum128(__m128d __v) {
+        return _mm_cvtsd_f64(_mm_add_sd(__v, _mm_unpackhi_pd(__v, __v)));
+    }
+
+    KNN_TARGET_SSE2 inline float squaredL2Sse2(const float* __a, const float* __b, long long __n) {
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        long long i = 0;
+        for (; i + 8 <= __n; i += 8) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(__a + i), _mm_loadu_ps(__b + i));
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(__a + i + 4), _mm_loadu_ps(__b + i + 4));
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(d1, d1));
+        }
+        for (; i + 4 <= __n; i += 4) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(__a + i), _mm_loadu_ps(__b + i));
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(d0, d0));
+        }
+        return hsum128(_mm_add_ps(acc0, acc1)) + squaredL2Scalar(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_SSE2 inline double squaredL2Sse2(const double* __a, const double* __b, long long __n) {
+        __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+        long long i = 0;
+        for (; i + 4 <= __n; i += 4) {
+            __m128d d0 = _mm_sub_pd(_mm_loadu_pd(__a + i), _mm_loadu_pd(__b + i));
+            __m128d d1 = _mm_sub_pd(_mm_loadu_pd(__a + i + 2), _mm_loadu_pd(__b + i + 2));
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+            acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+        }
+        for (; i + 2 <= __n; i += 2) {
+            __m128d d0 = _mm_sub_pd(_mm_loadu_pd(__a + i), _mm_loadu_pd(__b + i));
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+        }
+        return hsum128(_mm_add_pd(acc0, acc1)) + squaredL2Scalar(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_SSE2 inline float l1Sse2(const float* __a, const float* __b, long long __n) {
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+        long long i = 0;
+        for (; i + 8 <= __n; i += 8) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(__a + i), _mm_loadu_ps(__b + i));
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(__a + i + 4), _mm_loadu_ps(__b + i + 4));
+            acc0 = _mm_add_ps(acc0, _mm_andnot_ps(sign, d0));
+            acc1 = _mm_add_ps(acc1, _mm_andnot_ps(sign, d1));
+        }
+        for (; i + 4 <= __n; i += 4) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(__a + i), _mm_loadu_ps(__b + i));
+            acc0 = _mm_add_ps(acc0, _mm_andnot_ps(sign, d0));
+        }
+        return hsum128(_mm_add_ps(acc0, acc1)) + l1Scalar(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_SSE2 inline double l1Sse2(const double* __a, const double* __b, long long __n) {
+        const __m128d sign = _mm_set1_pd(-0.0);
+        __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+        long long i = 0;
+        for (; i + 4 <= __n; i += 4) {
+            __m128d d0 = _mm_sub_pd(_mm_loadu_pd(__a + i), _mm_loadu_pd(__b + i));
+            __m128d d1 = _mm_sub_pd(_mm_loadu_pd(__a + i + 2), _mm_loadu_pd(__b + i + 2));
+            acc0 = _mm_add_pd(acc0, _mm_andnot_pd(sign, d0));
+            acc1 = _mm_add_pd(acc1, _mm_andnot_pd(sign, d1));
+        }
+        for (; i + 2 <= __n; i += 2) {
+            __m128d d0 = _mm_sub_pd(_mm_loadu_pd(__a + i), _mm_loadu_pd(__b + i));
+            acc0 = _mm_add_pd(acc0, _mm_andnot_pd(sign, d0));
+        }
+        return hsum128(_mm_add_pd(acc0, acc1)) + l1Scalar(__a + i, __b + i, __n - i);
+    }
+
+    /* float储存转换为double后相减累加；int8储存扩展为int16后以madd累加为int32，
+       每`int8_block`个元素将int32的部分和并入int64，避免溢出 */
+
+    constexpr long long int8_block = 1LL << 16;
+
+    KNN_TARGET_SSE2 inline long long hsumEpi32(__m128i __v) {
+        alignas(16) std::int32_t lanes[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes), __v);
+        return static_cast<long long>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+    }
+    KNN_TARGET_SSE2 inline double squaredL2WideSse2(const float* __a, const float* __b, long long __n) {
+        __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+        long long i = 0;
+        for (; i + 4 <= __n; i += 4) {
+            __m128 va = _mm_loadu_ps(__a + i), vb = _mm_loadu_ps(__b + i);
+            __m128d d0 = _mm_sub_pd(_mm_cvtps_pd(va), _mm_cvtps_pd(vb));
+            __m128d d1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(va, va)), _mm_cvtps_pd(_mm_movehl_ps(vb, vb)));
+            acc0 = _mm_add_pd(acc0, _mm_mul_pd(d0, d0));
+            acc1 = _mm_add_pd(acc1, _mm_mul_pd(d1, d1));
+        }
+        return hsum128(_mm_add_pd(acc0, acc1)) + squaredL2WideScalar<double>(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_SSE2 inline double l1WideSse2(const float* __a, const float* __b, long long __n) {
+        const __m128d sign = _mm_set1_pd(-0.0);
+        __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd();
+        long long i = 0;
+        for (; i + 4 <= __n; i += 4) {
+            __m128 va = _mm_loadu_ps(__a + i), vb = _mm_loadu_ps(__b + i);
+            __m128d d0 = _mm_sub_pd(_mm_cvtps_pd(va), _mm_cvtps_pd(vb));
+            __m128d d1 = _mm_sub_pd(_mm_cvtps_pd(_mm_movehl_ps(va, va)), _mm_cvtps_pd(_mm_movehl_ps(vb, vb)));
+            acc0 = _mm_add_pd(acc0, _mm_andnot_pd(sign, d0));
+            acc1 = _mm_add_pd(acc1, _mm_andnot_pd(sign, d1));
+        }
+        return hsum128(_mm_add_pd(acc0, acc1)) + l1WideScalar<double>(__a + i, __b + i, __n - i);
+    }
+    /// @brief 16个int8符号扩展为两组int16后的差
+    KNN_TARGET_SSE2 inline void diffEpi8Sse2(const std::int8_t* __a, const std::int8_t* __b, __m128i& __lo, __m128i& __hi) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(__a));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(__b));
+        __lo = _mm_sub_epi16(_mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8), _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8));
+        __hi = _mm_sub_epi16(_mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8), _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8));
+    }
+    KNN_TARGET_SSE2 inline long long squaredL2WideSse2(const std::int8_t* __a, const std::int8_t* __b, long long __n) {
+        long long dis = 0, i = 0;
+        while (i + 16 <= __n) {
+            const long long end = std::min(__n, i + int8_block);
+            __m128i acc = _mm_setzero_si128();
+            for (; i + 16 <= end; i += 16) {
+                __m128i lo, hi;
+                diffEpi8Sse2(__a + i, __b + i, lo, hi);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+            }
+            dis += hsumEpi32(acc);
+        }
+        return dis + squaredL2WideScalar<long long>(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_SSE2 inline long long l1WideSse2(const std::int8_t* __a, const std::int8_t* __b, long long __n) {
+        const __m128i ones = _mm_set1_epi16(1), zero = _mm_setzero_si128();
+        long long dis = 0, i = 0;
+        while (i + 16 <= __n) {
+            const long long end = std::min(__n, i + int8_block);
+            __m128i acc = _mm_setzero_si128();
+            for (; i + 16 <= end; i += 16) {
+                __m128i lo, hi;
+                diffEpi8Sse2(__a + i, __b + i, lo, hi);
+                lo = _mm_max_epi16(lo, _mm_sub_epi16(zero, lo));
+                hi = _mm_max_epi16(hi, _mm_sub_epi16(zero, hi));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, ones));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, ones));
+            }
+            dis += hsumEpi32(acc);
+        }
+        return dis + l1WideScalar<long long>(__a + i, __b + i, __n - i);
+    }
+
+    KNN_TARGET_SSE2 inline void packedDotSse2(const float* __packed, long long __block, long long __dim,
+                                const float* __q, float* __out) {
+        for (long long r0 = 0; r0 < __block; r0 += 16) {
+            __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+            const float* col = __packed + r0;
+            for (long long j = 0; j < __dim; ++j, col += __block) {
+                __m128 qv = _mm_set1_ps(__q[j]);
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(qv, _mm_loadu_ps(col)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(qv, _mm_loadu_ps(col + 4)));
+                acc2 = _mm_add_ps(acc2, _mm_mul_ps(qv, _mm_loadu_ps(col + 8)));
+                acc3 = _mm_add_ps(acc3, _mm_mul_ps(qv, _mm_loadu_ps(col + 12)));
+            }
+            _mm_storeu_ps(__out + r0, acc0);
+            _mm_storeu_ps(__out + r0 + 4, acc1);
+            _mm_storeu_ps(__out + r0 + 8, acc2);
+            _mm_storeu_ps(__out + r0 + 12, acc3);
+        }
+    }
+    KNN_TARGET_SSE2 inline void packedDotSse2(const double* __packed, long long __block, long long __dim,
+                                const double* __q, double* __out) {
+        for (long long r0 = 0; r0 < __block; r0 += 8) {
+            __m128d acc0 = _mm_setzero_pd(), acc1 = _mm_setzero_pd(), acc2 = _mm_setzero_pd(), acc3 = _mm_setzero_pd();
+            const double* col = __packed + r0;
+            for (long long j = 0; j < __dim; ++j, col += __block) {
+                __m128d qv = _mm_set1_pd(__q[j]);
+                acc0 = _mm_add_pd(acc0, _mm_mul_pd(qv, _mm_loadu_pd(col)));
+                acc1 = _mm_add_pd(acc1, _mm_mul_pd(qv, _mm_loadu_pd(col + 2)));
+                acc2 = _mm_add_pd(acc2, _mm_mul_pd(qv, _mm_loadu_pd(col + 4)));
+                acc3 = _mm_add_pd(acc3, _mm_mul_pd(qv, _mm_loadu_pd(col + 6)));
+            }
+            _mm_storeu_pd(__out + r0, acc0);
+            _mm_storeu_pd(__out + r0 + 2, acc1);
+            _mm_storeu_pd(__out + r0 + 4, acc2);
+            _mm_storeu_pd(__out + r0 + 6, acc3);
+        }
+    }
+
+    /* AVX2 + FMA */
+
+    KNN_TARGET_AVX2 inline float hsum256(__m256 __v) {
+        __m128 lo = _mm256_castps256_ps128(__v);
+        __m128 hi = _mm256_extractf128_ps(__v, 1);
+        lo = _mm_add_ps(lo, hi);
+        __m128 shuf = _mm_movehdup_ps(lo);
+        __m128 sums = _mm_add_ps(lo, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+    }
+    KNN_TARGET_AVX2 inline double hsum256(__m256d __v) {
+        __m128d lo = _mm256_castpd256_pd128(__v);
+        __m128d hi = _mm256_extractf128_pd(__v, 1);
+        lo = _mm_add_pd(lo, hi);
+        return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+    }
+
+    KNN_TARGET_AVX2 inline float squaredL2Avx2(const float* __a, const float* __b, long long __n) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        long long i = 0;
+        for (; i + 16 <= __n; i += 16) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(__a + i), _mm256_loadu_ps(__b + i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(__a + i + 8), _mm256_loadu_ps(__b + i + 8));
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        }
+        for (; i + 8 <= __n; i += 8) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(__a + i), _mm256_loadu_ps(__b + i));
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        }
+        float dis = hsum256(_mm256_add_ps(acc0, acc1));
+        if (i + 4 <= __n) {
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(__a + i), _mm_loadu_ps(__b + i));
+            dis += hsum128(_mm_mul_ps(d0, d0));
+            i += 4;
+        }
+        return dis + squaredL2Scalar(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX2 inline double squaredL2Avx2(const double* __a, const double* __b, long long __n) {
+        __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+        long long i = 0;
+        for (; i + 8 <= __n; i += 8) {
+            __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(__a + i), _mm256_loadu_pd(__b + i));
+            __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(__a + i + 4), _mm256_loadu_pd(__b + i + 4));
+            acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+            acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+        }
+        for (; i + 4 <= __n; i += 4) {
+            __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(__a + i), _mm256_loadu_pd(__b + i));
+            acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+        }
+        return hsum256(_mm256_add_pd(acc0, acc1)) + squaredL2Scalar(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX2 inline float l1Avx2(const float* __a, const float* __b, long long __n) {
+        const __m256 sign = _mm256_set1_ps(-0.0f);
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        long long i = 0;
+        for (; i + 16 <= __n; i += 16) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(__a + i), _mm256_loadu_ps(__b + i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(__a + i + 8), _mm256_loadu_ps(__b + i + 8));
+            acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign, d0));
+            acc1 = _mm256_add_ps(acc1, _mm256_andnot_ps(sign, d1));
+        }
+        for (; i + 8 <= __n; i += 8) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(__a + i), _mm256_loadu_ps(__b + i));
+            acc0 = _mm256_add_ps(acc0, _mm256_andnot_ps(sign, d0));
+        }
+        return hsum256(_mm256_add_ps(acc0, acc1)) + l1Scalar(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX2 inline double l1Avx2(const double* __a, const double* __b, long long __n) {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+        long long i = 0;
+        for (; i + 8 <= __n; i += 8) {
+            __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(__a + i), _mm256_loadu_pd(__b + i));
+            __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(__a + i + 4), _mm256_loadu_pd(__b + i + 4));
+            acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign, d0));
+            acc1 = _mm256_add_pd(acc1, _mm256_andnot_pd(sign, d1));
+        }
+        for (; i + 4 <= __n; i += 4) {
+            __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(__a + i), _mm256_loadu_pd(__b + i));
+            acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign, d0));
+        }
+        return hsum256(_mm256_add_pd(acc0, acc1)) + l1Scalar(__a + i, __b + i, __n - i);
+    }
+
+    KNN_TARGET_AVX2 inline double squaredL2WideAvx2(const float* __a, const float* __b, long long __n) {
+        __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+        long long i = 0;
+        for (; i + 8 <= __n; i += 8) {
+            __m256d d0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(__a + i)), _mm256_cvtps_pd(_mm_loadu_ps(__b + i)));
+            __m256d d1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(__a + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(__b + i + 4)));
+            acc0 = _mm256_fmadd_pd(d0, d0, acc0);
+            acc1 = _mm256_fmadd_pd(d1, d1, acc1);
+        }
+        return hsum256(_mm256_add_pd(acc0, acc1)) + squaredL2WideScalar<double>(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX2 inline double l1WideAvx2(const float* __a, const float* __b, long long __n) {
+        const __m256d sign = _mm256_set1_pd(-0.0);
+        __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+        long long i = 0;
+        for (; i + 8 <= __n; i += 8) {
+            __m256d d0 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(__a + i)), _mm256_cvtps_pd(_mm_loadu_ps(__b + i)));
+            __m256d d1 = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(__a + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(__b + i + 4)));
+            acc0 = _mm256_add_pd(acc0, _mm256_andnot_pd(sign, d0));
+            acc1 = _mm256_add_pd(acc1, _mm256_andnot_pd(sign, d1));
+        }
+        return hsum256(_mm256_add_pd(acc0, acc1)) + l1WideScalar<double>(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX2 inline long long hsumEpi32Avx2(__m256i __v) {
+        alignas(32) std::int32_t lanes[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), __v);
+        long long sum = 0;
+        for (int l = 0; l < 8; ++l) sum += lanes[l];
+        return sum;
+    }
+    KNN_TARGET_AVX2 inline __m256i diffEpi8Avx2(const std::int8_t* __a, const std::int8_t* __b) {
+        return _mm256_sub_epi16(_mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(__a))),
+                                _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(__b))));
+    }
+    KNN_TARGET_AVX2 inline long long squaredL2WideAvx2(const std::int8_t* __a, const std::int8_t* __b, long long __n) {
+        long long dis = 0, i = 0;
+        while (i + 32 <= __n) {
+            const long long end = std::min(__n, i + int8_block);
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            for (; i + 32 <= end; i += 32) {
+                __m256i d0 = diffEpi8Avx2(__a + i, __b + i), d1 = diffEpi8Avx2(__a + i + 16, __b + i + 16);
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(d0, d0));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(d1, d1));
+            }
+            dis += hsumEpi32Avx2(_mm256_add_epi32(acc0, acc1));
+        }
+        if (i + 16 <= __n) {
+            __m256i d0 = diffEpi8Avx2(__a + i, __b + i);
+            dis += hsumEpi32Avx2(_mm256_madd_epi16(d0, d0));
+            i += 16;
+        }
+        return dis + squaredL2WideScalar<long long>(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX2 inline long long l1WideAvx2(const std::int8_t* __a, const std::int8_t* __b, long long __n) {
+        const __m256i ones = _mm256_set1_epi16(1);
+        long long dis = 0, i = 0;
+        while (i + 32 <= __n) {
+            const long long end = std::min(__n, i + int8_block);
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            for (; i + 32 <= end; i += 32) {
+                __m256i d0 = _mm256_abs_epi16(diffEpi8Avx2(__a + i, __b + i));
+                __m256i d1 = _mm256_abs_epi16(diffEpi8Avx2(__a + i + 16, __b + i + 16));
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(d0, ones));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(d1, ones));
+            }
+            dis += hsumEpi32Avx2(_mm256_add_epi32(acc0, acc1));
+        }
+        if (i + 16 <= __n) {
+            dis += hsumEpi32Avx2(_mm256_madd_epi16(_mm256_abs_epi16(diffEpi8Avx2(__a + i, __b + i)), ones));
+            i += 16;
+        }
+        return dis + l1WideScalar<long long>(__a + i, __b + i, __n - i);
+    }
+
+    KNN_TARGET_AVX2 inline void packedDotAvx2(const float* __packed, long long __block, long long __dim,
+                                const float* __q, float* __out) {
+        for (long long r0 = 0; r0 < __block; r0 += 32) {
+            __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps(), acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+            const float* col = __packed + r0;
+            for (long long j = 0; j < __dim; ++j, col += __block) {
+                __m256 qv = _mm256_set1_ps(__q[j]);
+                acc0 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(col), acc0);
+                acc1 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(col + 8), acc1);
+                acc2 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(col + 16), acc2);
+                acc3 = _mm256_fmadd_ps(qv, _mm256_loadu_ps(col + 24), acc3);
+            }
+            _mm256_storeu_ps(__out + r0, acc0);
+            _mm256_storeu_ps(__out + r0 + 8, acc1);
+            _mm256_storeu_ps(__out + r0 + 16, acc2);
+            _mm256_storeu_ps(__out + r0 + 24, acc3);
+        }
+    }
+    KNN_TARGET_AVX2 inline void packedDotAvx2(const double* __packed, long long __block, long long __dim,
+                                const double* __q, double* __out) {
+        for (long long r0 = 0; r0 < __block; r0 += 16) {
+            __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd(), acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+            const double* col = __packed + r0;
+            for (long long j = 0; j < __dim; ++j, col += __block) {
+                __m256d qv = _mm256_set1_pd(__q[j]);
+                acc0 = _mm256_fmadd_pd(qv, _mm256_loadu_pd(col), acc0);
+                acc1 = _mm256_fmadd_pd(qv, _mm256_loadu_pd(col + 4), acc1);
+                acc2 = _mm256_fmadd_pd(qv, _mm256_loadu_pd(col + 8), acc2);
+                acc3 = _mm256_fmadd_pd(qv, _mm256_loadu_pd(col + 12), acc3);
+            }
+            _mm256_storeu_pd(__out + r0, acc0);
+            _mm256_storeu_pd(__out + r0 + 4, acc1);
+            _mm256_storeu_pd(__out + r0 + 8, acc2);
+            _mm256_storeu_pd(__out + r0 + 12, acc3);
+        }
+    }
+
+    /* AVX-512F，尾部使用掩码加载 */
+
+    // GCC 12中`_mm512_reduce_add_*`、`_mm512_extractf64x4_pd`与`_mm512_cvtps_pd`等均以`_mm*_undefined_*`为源，
+    // 会报`-Wmaybe-uninitialized`，因此改用全掩码的零掩码形式；水平求和取出两半后沿用AVX2的做法
+    KNN_TARGET_AVX512 inline __m512d widen512(__m256 __v) {
+        return _mm512_maskz_cvtps_pd((__mmask8)0xFF, __v);
+    }
+    KNN_TARGET_AVX512 inline double hsum512(__m512d __v) {
+        __m256d lo = _mm512_maskz_extractf64x4_pd((__mmask8)0xF, __v, 0);
+        __m256d hi = _mm512_maskz_extractf64x4_pd((__mmask8)0xF, __v, 1);
+        return hsum256(_mm256_add_pd(lo, hi));
+    }
+    KNN_TARGET_AVX512 inline float hsum512(__m512 __v) {
+        __m256 lo = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xF, _mm512_castps_pd(__v), 0));
+        __m256 hi = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xF, _mm512_castps_pd(__v), 1));
+        return hsum256(_mm256_add_ps(lo, hi));
+    }
+
+    KNN_TARGET_AVX512 inline float squaredL2Avx512(const float* __a, const float* __b, long long __n) {
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        long long i = 0;
+        for (; i + 32 <= __n; i += 32) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(__a + i), _mm512_loadu_ps(__b + i));
+            __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(__a + i + 16), _mm512_loadu_ps(__b + i + 16));
+            acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+        }
+        for (; i < __n; i += 16) {
+            __mmask16 mask = (__n - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (__n - i)) - 1);
+            __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, __a + i), _mm512_maskz_loadu_ps(mask, __b + i));
+            acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        }
+        return hsum512(_mm512_add_ps(acc0, acc1));
+    }
+    KNN_TARGET_AVX512 inline double squaredL2Avx512(const double* __a, const double* __b, long long __n) {
+        __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+        long long i = 0;
+        for (; i + 16 <= __n; i += 16) {
+            __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(__a + i), _mm512_loadu_pd(__b + i));
+            __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(__a + i + 8), _mm512_loadu_pd(__b + i + 8));
+            acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+            acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+        }
+        for (; i < __n; i += 8) {
+            __mmask8 mask = (__n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (__n - i)) - 1);
+            __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, __a + i), _mm512_maskz_loadu_pd(mask, __b + i));
+            acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+        }
+        return hsum512(_mm512_add_pd(acc0, acc1));
+    }
+    KNN_TARGET_AVX512 inline float l1Avx512(const float* __a, const float* __b, long long __n) {
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        long long i = 0;
+        for (; i + 32 <= __n; i += 32) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(__a + i), _mm512_loadu_ps(__b + i));
+            __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(__a + i + 16), _mm512_loadu_ps(__b + i + 16));
+            acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(d0));
+            acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(d1));
+        }
+        for (; i < __n; i += 16) {
+            __mmask16 mask = (__n - i >= 16) ? (__mmask16)0xFFFF : (__mmask16)((1u << (__n - i)) - 1);
+            __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, __a + i), _mm512_maskz_loadu_ps(mask, __b + i));
+            acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(d0));
+        }
+        return hsum512(_mm512_add_ps(acc0, acc1));
+    }
+    KNN_TARGET_AVX512 inline double l1Avx512(const double* __a, const double* __b, long long __n) {
+        __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+        long long i = 0;
+        for (; i + 16 <= __n; i += 16) {
+            __m512d d0 = _mm512_sub_pd(_mm512_loadu_pd(__a + i), _mm512_loadu_pd(__b + i));
+            __m512d d1 = _mm512_sub_pd(_mm512_loadu_pd(__a + i + 8), _mm512_loadu_pd(__b + i + 8));
+            acc0 = _mm512_add_pd(acc0, _mm512_abs_pd(d0));
+            acc1 = _mm512_add_pd(acc1, _mm512_abs_pd(d1));
+        }
+        for (; i < __n; i += 8) {
+            __mmask8 mask = (__n - i >= 8) ? (__mmask8)0xFF : (__mmask8)((1u << (__n - i)) - 1);
+            __m512d d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(mask, __a + i), _mm512_maskz_loadu_pd(mask, __b + i));
+            acc0 = _mm512_add_pd(acc0, _mm512_abs_pd(d0));
+        }
+        return hsum512(_mm512_add_pd(acc0, acc1));
+    }
+
+    KNN_TARGET_AVX512 inline double squaredL2WideAvx512(const float* __a, const float* __b, long long __n) {
+        __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+        long long i = 0;
+        for (; i + 16 <= __n; i += 16) {
+            __m512d d0 = _mm512_sub_pd(widen512(_mm256_loadu_ps(__a + i)), widen512(_mm256_loadu_ps(__b + i)));
+            __m512d d1 = _mm512_sub_pd(widen512(_mm256_loadu_ps(__a + i + 8)), widen512(_mm256_loadu_ps(__b + i + 8)));
+            acc0 = _mm512_fmadd_pd(d0, d0, acc0);
+            acc1 = _mm512_fmadd_pd(d1, d1, acc1);
+        }
+        return hsum512(_mm512_add_pd(acc0, acc1)) + squaredL2WideScalar<double>(__a + i, __b + i, __n - i);
+    }
+    KNN_TARGET_AVX512 inline double l1WideAvx512(const float* __a, const float* __b, long long __n) {
+        __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+        long long i = 0;
+        for (; i + 16 <= __n; i += 16) {
+            __m512d d0 = _mm512_sub_pd(widen512(_mm256_loadu_ps(__a + i)), widen512(_mm256_loadu_ps(__b + i)));
+            __m512d d1 = _mm512_sub_pd(widen512(_mm256_loadu_ps(__a + i + 8)), widen512(_mm256_loadu_ps(__b + i + 8)));
+            acc0 = _mm512_add_pd(acc0, _mm512_abs_pd(d0));
+            acc1 = _mm512_add_pd(acc1, _mm512_abs_pd(d1));
+        }
+        return hsum512(_mm512_add_pd(acc0, acc1)) + l1WideScalar<double>(__a + i, __b + i, __n - i);
+    }
+
+    KNN_TARGET_AVX512 inline void packedDotAvx512(const float* __packed, long long __block, long long __dim,
+                                const float* __q, float* __out) {
+        for (long long r0 = 0; r0 < __block; r0 += 64) {
+            __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps(), acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+            const float* col = __packed + r0;
+            for (long long j = 0; j < __dim; ++j, col += __block) {
+                __m512 qv = _mm512_set1_ps(__q[j]);
+                acc0 = _mm512_fmadd_ps(qv, _mm512_loadu_ps(col), acc0);
+                acc1 = _mm512_fmadd_ps(qv, _mm512_loadu_ps(col + 16), acc1);
+                acc2 = _mm512_fmadd_ps(qv, _mm512_loadu_ps(col + 32), acc2);
+                acc3 = _mm512_fmadd_ps(qv, _mm512_loadu_ps(col + 48), acc3);
+            }
+            _mm512_storeu_ps(__out + r0, acc0);
+            _mm512_storeu_ps(__out + r0 + 16, acc1);
+            _mm512_storeu_ps(__out + r0 + 32, acc2);
+            _mm512_storeu_ps(__out + r0 + 48, acc3);
+        }
+    }
+    KNN_TARGET_AVX512 inline void packedDotAvx512(const double* __packed, long long __block, long long __dim,
+                                const double* __q, double* __out) {
+        for (long long r0 = 0; r0 < __block; r0 += 32) {
+            __m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd(), acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+            const double* col = __packed + r0;
+            for (long long j = 0; j < __dim; ++j, col += __block) {
+                __m512d qv = _mm512_set1_pd(__q[j]);
+                acc0 = _mm512_fmadd_pd(qv, _mm512_loadu_pd(col), acc0);
+                acc1 = _mm512_fmadd_pd(qv, _mm512_loadu_pd(col + 8), acc1);
+                acc2 = _mm512_fmadd_pd(qv, _mm512_loadu_pd(col + 16), acc2);
+                acc3 = _mm512_fmadd_pd(qv, _mm512_loadu_pd(col + 24), acc3);
+            }
+            _mm512_storeu_pd(__out + r0, acc0);
+            _mm512_storeu_pd(__out + r0 + 8, acc1);
+            _mm512_storeu_pd(__out + r0 + 16, acc2);
+            _mm512_storeu_pd(__out + r0 + 24, acc3);
+        }
+    }
+
+#endif /* KNN_SIMD_X86 */
+
+    /// @brief 按指令集等级选出的一组内核函数指针
+    struct Kernels {
+        Level level;
+        float (*squared_l2_f)(const float*, const float*, long long);
+        double (*squared_l2_d)(const double*, const double*, long long);
+        float (*l1_f)(const float*, const float*, long long);
+        double (*l1_d)(const double*, const double*, long long);
+        void (*packed_dot_f)(const float*, long long, long long, const float*, float*);
+        void (*packed_dot_d)(const double*, long long, long long, const double*, double*);
+        double (*squared_l2_fw)(const float*, const float*, long long);
+        double (*l1_fw)(const float*, const float*, long long);
+        long long (*squared_l2_i8)(const std::int8_t*, const std::int8_t*, long long);
+        long long (*l1_i8)(const std::int8_t*, const std::int8_t*, long long);
+    };
+
+    /// @brief 为指定等级构造内核表
+    inline Kernels makeKernels(Level __level) {
+        Kernels ks{Level::scalar, squaredL2Scalar<float>, squaredL2Scalar<double>,
+                   l1Scalar<float>, l1Scalar<double>,
+                   packedDotScalar<float>, packedDotScalar<double>,
+                   squaredL2WideScalar<double, float>, l1WideScalar<double, float>,
+                   squaredL2WideScalar<long long, std::int8_t>, l1WideScalar<long long, std::int8_t>};
+#if KNN_SIMD_X86
+        switch (__level) {
+            case Level::avx512:
+                // AVX-512F没有字节与字运算，int8沿用AVX2内核
+                ks = {Level::avx512, squaredL2Avx512, squaredL2Avx512, l1Avx512, l1Avx512,
+                      packedDotAvx512, packedDotAvx512, squaredL2WideAvx512, l1WideAvx512,
+                      squaredL2WideAvx2, l1WideAvx2};
+                break;
+            case Level::avx2:
+                ks = {Level::avx2, squaredL2Avx2, squaredL2Avx2, l1Avx2, l1Avx2,
+                      packedDotAvx2, packedDotAvx2, squaredL2WideAvx2, l1WideAvx2,
+                      squaredL2WideAvx2, l1WideAvx2};
+                break;
+            case Level::sse2:
+                ks = {Level::sse2, squaredL2Sse2, squaredL2Sse2, l1Sse2, l1Sse2,
+                      packedDotSse2, packedDotSse2, squaredL2WideSse2, l1WideSse2,
+                      squaredL2WideSse2, l1WideSse2};
+                break;
+            default:
+                break;
+        }
+#endif
+        return ks;
+    }
+
+    /// @brief 当前进程使用的内核表，首次调用时检测CPU
+    inline const Kernels& kernels() {
+        static const Kernels ks = makeKernels(detectLevel());
+        return ks;
+    }
+
+    inline float squaredL2(const float* __a, const float* __b, long long __n) {
+        return kernels().squared_l2_f(__a, __b, __n);
+    }
+    inline double squaredL2(const double* __a, const double* __b, long long __n) {
+        return kernels().squared_l2_d(__a, __b, __n);
+    }
+    inline float l1(const float* __a, const float* __b, long long __n) {
+        return kernels().l1_f(__a, __b, __n);
+    }
+    inline double l1(const double* __a, const double* __b, long long __n) {
+        return kernels().l1_d(__a, __b, __n);
+    }
+    /// @brief `float`储存以`double`累加，`int8`储存以整数精确累加
+    inline double squaredL2Wide(const float* __a, const float* __b, long long __n) {
+        return kernels().squared_l2_fw(__a, __b, __n);
+    }
+    inline double l1Wide(const float* __a, const float* __b, long long __n) {
+        return kernels().l1_fw(__a, __b, __n);
+    }
+    inline long long squaredL2Wide(const std::int8_t* __a, const std::int8_t* __b, long long __n) {
+        return kernels().squared_l2_i8(__a, __b, __n);
+    }
+    inline long long l1Wide(const std::int8_t* __a, const std::int8_t* __b, long long __n) {
+        return kernels().l1_i8(__a, __b, __n);
+    }
+
+    /// @brief 计算 __out[r] = Σ_j __q[j] * __packed[j * __block + r]
+    /// @param __packed 按维度转置打包的行块，共`__dim`列，每列`__block`个元素
+    /// @param __block 块内行数，须为64的倍数
+    inline void packedDot(const float* __packed, long long __block, long long __dim,
+                          const float* __q, float* __out) {
+        kernels().packed_dot_f(__packed, __block, __dim, __q, __out);
+    }
+    inline void packedDot(const double* __packed, long long __block, long long __dim,
+                          const double* __q, double* __out) {
+        kernels().packed_dot_d(__packed, __block, __dim, __q, __out);
+    }
+
+    /// @brief 该类型是否有向量化内核
+    template<class __T>
+    inline constexpr bool has_kernel = std::is_same_v<__T, float> || std::is_same_v<__T, double>;
+    /// @brief 储存类型`__T`在距离类型`__DT`下是否有加宽累加的向量化内核
+    template<class __T, class __DT>
+    inline constexpr bool has_wide_kernel =
+        (std::is_same_v<__T, float> && std::is_same_v<__DT, double>) ||
+        (std::is_same_v<__T, std::int8_t> && (std::is_floating_point_v<__DT> || sizeof(__DT) >= sizeof(long long)));
+
+} /* namespace knn::simd */
+
+#endif
+
+#endif /* DS_KNN_SIMD_HPP */